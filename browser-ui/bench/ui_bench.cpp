@@ -0,0 +1,486 @@
+// squ1d-ui-bench: microbenchmarks of the UI hot paths at 1080p, 4K and 8K.
+//
+// Every case runs once to warm up (caches, scratch buffers), then in
+// doubling batches until it has run for at least --min-time. It reports
+// ns per operation, pixels touched per second and heap allocations per
+// operation; --json writes the same as one object per case, keyed by
+// name, size and threads, so two builds can be compared.
+//
+// Usage: squ1d-ui-bench [--json FILE] [--filter TEXT] [--min-time MS] [--sizes 1080p,4k,8k]
+
+#include "bmp_loader.h"
+#include "compositor.h"
+#include "display_list.h"
+#include "pixel_codec.h"
+#include "present.h"
+#include "tab_manager.h"
+#include "ui_renderer.h"
+#include "work_pool.h"
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+std::atomic<uint64_t> allocation_count{0};
+
+} // namespace
+
+// Count every heap allocation in the process
+void* operator new(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+// Not inlined, or GCC pairs the free() with its builtin operator new and warns
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+struct FrameSize {
+    const char* name;
+    int width;
+    int height;
+};
+
+const FrameSize FRAME_SIZES[] = {
+    {"1080p", 1920, 1080},
+    {"4k", 3840, 2160},
+    {"8k", 7680, 4320},
+};
+
+// Items in the paint benchmark's display list
+constexpr int PAINT_ITEMS = 3000;
+
+// Tab titles drawn per iteration of the text benchmark
+constexpr int TEXT_TITLES = 200;
+
+struct Result {
+    std::string name;
+    std::string size;
+    int threads;
+    uint64_t iterations;
+    double ns_per_op;
+    double pixels_per_second;
+    double allocations_per_op;
+};
+
+struct Options {
+    std::string json_path;
+    std::string filter;
+    double min_time_ms = 500;
+    std::vector<FrameSize> sizes;
+};
+
+class Bench {
+public:
+    explicit Bench(const Options& options) : options(options) {}
+
+    // Time op, which touches pixels pixels per call (0 if that means
+    // nothing for it)
+    template <typename Op>
+    void run(const std::string& name, const std::string& size, int threads, uint64_t pixels, Op&& op) {
+        if (!options.filter.empty() && name.find(options.filter) == std::string::npos) {
+            return;
+        }
+
+        op();
+
+        using Clock = std::chrono::steady_clock;
+        uint64_t iterations = 0;
+        uint64_t batch = 1;
+        uint64_t allocations = 0;
+        double elapsed_ns = 0;
+        while (elapsed_ns < options.min_time_ms * 1e6) {
+            const uint64_t allocations_before = allocation_count.load(std::memory_order_relaxed);
+            const auto start = Clock::now();
+            for (uint64_t i = 0; i < batch; ++i) {
+                op();
+            }
+            elapsed_ns += std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+            allocations += allocation_count.load(std::memory_order_relaxed) - allocations_before;
+            iterations += batch;
+            batch *= 2;
+        }
+
+        Result result;
+        result.name = name;
+        result.size = size;
+        result.threads = threads;
+        result.iterations = iterations;
+        result.ns_per_op = elapsed_ns / iterations;
+        result.pixels_per_second = pixels ? pixels * 1e9 / result.ns_per_op : 0;
+        result.allocations_per_op = static_cast<double>(allocations) / iterations;
+        print(result);
+        results.push_back(result);
+    }
+
+    bool write_json(const std::string& path) const {
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "Cannot write " << path << std::endl;
+            return false;
+        }
+        out << "{\n  \"hardware_threads\": " << std::thread::hardware_concurrency()
+            << ",\n  \"min_time_ms\": " << options.min_time_ms << ",\n  \"benchmarks\": [\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result& r = results[i];
+            out << "    {\"name\": \"" << r.name << "\", \"size\": \"" << r.size << "\", \"threads\": " << r.threads
+                << ", \"iterations\": " << r.iterations << ", \"ns_per_op\": " << r.ns_per_op
+                << ", \"pixels_per_second\": " << r.pixels_per_second
+                << ", \"allocations_per_op\": " << r.allocations_per_op << "}"
+                << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        out << "  ]\n}\n";
+        return static_cast<bool>(out);
+    }
+
+private:
+    static void print(const Result& r) {
+        char line[256];
+        std::snprintf(line, sizeof(line), "%-28s %-6s %3d  %14.0f ns/op  %9.1f Mpx/s  %8.2f allocs/op",
+                      r.name.c_str(), r.size.c_str(), r.threads, r.ns_per_op, r.pixels_per_second / 1e6,
+                      r.allocations_per_op);
+        std::cout << line << std::endl;
+    }
+
+    const Options& options;
+    std::vector<Result> results;
+};
+
+// A plausible tab title for tab i
+std::string tab_title(int i) {
+    return "Tab " + std::to_string(i) + " - Example Domain";
+}
+
+// Write a w x h 24-bit BMP of a gradient to path
+bool write_bmp(const std::string& path, int w, int h) {
+    const size_t row_size = (static_cast<size_t>(w) * 3 + 3) & ~size_t{3};
+    const uint32_t pixel_bytes = static_cast<uint32_t>(row_size * h);
+    uint8_t header[54] = {'B', 'M'};
+    auto put_u32 = [&](int offset, uint32_t v) {
+        for (int i = 0; i < 4; ++i) {
+            header[offset + i] = static_cast<uint8_t>(v >> (8 * i));
+        }
+    };
+    put_u32(2, 54 + pixel_bytes);
+    put_u32(10, 54);
+    put_u32(14, 40);
+    put_u32(18, static_cast<uint32_t>(w));
+    put_u32(22, static_cast<uint32_t>(h));
+    header[26] = 1;  // planes
+    header[28] = 24; // bits per pixel
+    put_u32(34, pixel_bytes);
+
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    std::vector<uint8_t> row(row_size);
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            row[x * 3] = static_cast<uint8_t>(x);
+            row[x * 3 + 1] = static_cast<uint8_t>(y);
+            row[x * 3 + 2] = static_cast<uint8_t>(x + y);
+        }
+        out.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row_size));
+    }
+    return static_cast<bool>(out);
+}
+
+// Chrome-like display list over a w x h window: rows of tabs (a fill, a
+// border and a title each), count items in all
+void build_paint_list(DisplayList& list, int w, int h, int count) {
+    list.begin();
+    uint32_t id = 1;
+    int i = 0;
+    for (int y = 5; y + 30 <= h && i < count; y += 35) {
+        for (int x = 5; x + 100 <= w && i < count; x += 105, i += 3) {
+            list.add_tab(id, Rect(x, y, 100, 30), tab_title(i), (i / 3) % 7 == 0);
+            id += 3;
+        }
+    }
+    list.end();
+    list.clear_damage();
+}
+
+void bench_size(Bench& bench, const FrameSize& size) {
+    const int w = size.width;
+    const int h = size.height;
+    const uint64_t frame_pixels = static_cast<uint64_t>(w) * h;
+
+    UIRenderer ui(w, h);
+
+    // Primitives
+    bench.run("clear", size.name, 1, frame_pixels, [&] { ui.clear(Color(255, 255, 255)); });
+    bench.run("fill_rect/opaque", size.name, 1, frame_pixels,
+              [&] { ui.fill_rect(Rect(0, 0, w, h), Color(240, 240, 240)); });
+    bench.run("fill_rect/translucent", size.name, 1, frame_pixels,
+              [&] { ui.fill_rect(Rect(0, 0, w, h), Color(100, 150, 255, 128)); });
+    bench.run("draw_rounded_rect/fill", size.name, 1, frame_pixels,
+              [&] { ui.draw_rounded_rect(Rect(0, 0, w, h), Color(230, 230, 230), 12.0f, 0.0f); });
+
+    // Tab-sized borders tiling the frame
+    uint64_t border_pixels = 0;
+    std::vector<Rect> borders;
+    for (int y = 0; y + 25 <= h; y += 30) {
+        for (int x = 0; x + 100 <= w; x += 105) {
+            borders.emplace_back(x, y, 100, 25);
+            border_pixels += 2 * (100 + 25);
+        }
+    }
+    bench.run("draw_rounded_rect/border", size.name, 1, border_pixels, [&] {
+        for (const Rect& r : borders) {
+            ui.draw_rounded_rect(r, Theme::SEPARATOR, 4.0f, 1.0f);
+        }
+    });
+
+    // The tab strip's text for a window with many tabs
+    uint64_t text_pixels = 0;
+    std::vector<std::pair<std::string, Rect>> titles;
+    for (int i = 0; i < TEXT_TITLES; ++i) {
+        const int per_row = std::max(1, w / 105);
+        const Rect slot((i % per_row) * 105 + 10, (i / per_row) * 30 % std::max(1, h - 30), 90, 25);
+        titles.emplace_back(tab_title(i), slot);
+        text_pixels += static_cast<uint64_t>(GlyphCache::measure(titles.back().first, 11.0f)) *
+                       GlyphCache::line_height(11.0f);
+    }
+    bench.run("draw_text/tab_titles", size.name, 1, text_pixels, [&] {
+        for (const auto& title : titles) {
+            ui.draw_text(title.first, title.second.x, title.second.y, Theme::TAB_TEXT, 11.0f);
+        }
+    });
+
+    // Full repaints of a busy display list, serial and tiled on the pool
+    DisplayList list;
+    build_paint_list(list, w, h, PAINT_ITEMS);
+    std::vector<int> thread_counts = {1, 2, 4, static_cast<int>(std::thread::hardware_concurrency())};
+    std::sort(thread_counts.begin(), thread_counts.end());
+    thread_counts.erase(std::unique(thread_counts.begin(), thread_counts.end()), thread_counts.end());
+    for (int threads : thread_counts) {
+        if (threads < 1) {
+            continue;
+        }
+        WorkStealingPool pool(threads);
+        ui.set_thread_pool(threads > 1 ? &pool : nullptr);
+        bench.run("paint/display_list", size.name, threads, frame_pixels,
+                  [&] { ui.paint(list, PixelRect{0, 0, w, h}, Color(255, 255, 255)); });
+        ui.set_thread_pool(nullptr);
+    }
+
+    // Background tab storage, on the frame just painted: it looks more like
+    // a page than noise would
+    const uint8_t* page = reinterpret_cast<const uint8_t*>(ui.get_frame_buffer().data());
+    std::vector<uint8_t> restored(frame_pixels * 4);
+    for (int threads : thread_counts) {
+        if (threads < 1) {
+            continue;
+        }
+        WorkStealingPool pool(threads);
+        WorkStealingPool* tab_pool = threads > 1 ? &pool : nullptr;
+        CompressedPixels compressed;
+        bench.run("tab/compress", size.name, threads, frame_pixels,
+                  [&] { compressed = compress_pixels(page, w, h, static_cast<size_t>(w) * 4, tab_pool); });
+        bench.run("tab/decompress", size.name, threads, frame_pixels, [&] {
+            if (!decompress_pixels(compressed, restored.data(), tab_pool)) {
+                std::abort();
+            }
+        });
+        if (std::memcmp(restored.data(), page, restored.size()) != 0) {
+            std::cerr << "tab/decompress: frame did not round-trip" << std::endl;
+            std::abort();
+        }
+    }
+
+    // The present path: tab content composited over the chrome onto a
+    // window-sized surface, straight and scaled, in the usual window
+    // layout and in one that needs converting
+    const int content_w = w - 20;
+    const int content_h = h - 95;
+    const uint64_t content_pixels = static_cast<uint64_t>(content_w) * content_h;
+    std::vector<uint8_t> content(content_pixels * 4);
+    for (size_t i = 0; i < content.size(); i += 4) {
+        const uint32_t pixel = 0xff000000u | static_cast<uint32_t>(i * 2654435761u >> 8);
+        std::memcpy(&content[i], &pixel, 4);
+    }
+    std::vector<int32_t> scale_columns;
+    std::vector<uint32_t> scale_row;
+    std::vector<uint32_t> convert_row;
+    const uint32_t* backdrop = ui.get_frame_buffer().data();
+    const struct {
+        const char* name;
+        uint32_t format;
+    } layouts[] = {{"argb8888", SDL_PIXELFORMAT_ARGB8888}, {"rgba32", SDL_PIXELFORMAT_RGBA32}};
+    for (const auto& layout : layouts) {
+        SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32, layout.format);
+        if (!surface) {
+            std::cerr << "Surface creation failed: " << SDL_GetError() << std::endl;
+            continue;
+        }
+        const std::string suffix = std::string("/") + layout.name;
+        bench.run("present/blit" + suffix, size.name, 1, frame_pixels, [&] {
+            blit_argb(surface, reinterpret_cast<const uint8_t*>(backdrop), static_cast<size_t>(w) * 4, 0, 0, w, h);
+        });
+        bench.run("present/composite" + suffix, size.name, 1, content_pixels, [&] {
+            composite_argb(surface, backdrop, static_cast<size_t>(w), content.data(),
+                           static_cast<size_t>(content_w) * 4, 10, 85, content_w, content_h, convert_row);
+        });
+        bench.run("present/scaled" + suffix, size.name, 1, content_pixels, [&] {
+            composite_scaled_argb(surface, backdrop, static_cast<size_t>(w), content.data(), content_w / 2,
+                                  content_h / 2, static_cast<size_t>(content_w / 2) * 4, 10, 85, content_w, content_h, scale_columns, scale_row,
+                                  convert_row);
+        });
+        SDL_FreeSurface(surface);
+    }
+
+    // Tab content updates: a whole frame of damage from the renderer
+    Tab tab("https://example.com");
+    tab.set_content(PixelBuffer::allocate(content_w, content_h));
+    auto damaged = PixelBuffer::allocate(content_w, content_h);
+    std::memcpy(damaged->mutable_data(), content.data(), content.size());
+    const std::vector<PixelRect> full_damage = {PixelRect{0, 0, content_w, content_h}};
+    bench.run("tab/apply_damage", size.name, 1, content_pixels, [&] { tab.apply_damage(*damaged, full_damage); });
+
+    // A whole frame, then a stream of small re-renders that each patch one
+    // line of text: everything outside the rects must survive the patches
+    Tab typing("https://example.com");
+    auto first = PixelBuffer::allocate(content_w, content_h);
+    std::memcpy(first->mutable_data(), content.data(), content.size());
+    typing.set_content(std::move(first));
+    const std::vector<PixelRect> line_damage = {PixelRect{0, content_h / 2, content_w / 2, 16}};
+    auto matches_page = [&] {
+        return typing.rendered_content &&
+               std::memcmp(typing.rendered_content->data(), content.data(), content.size()) == 0;
+    };
+    for (int i = 0; i < 2; ++i) {
+        if (!typing.apply_damage(*damaged, line_damage) || !matches_page()) {
+            std::cerr << "tab/apply_damage/line: patch " << i + 1 << " lost the rest of the frame" << std::endl;
+            std::abort();
+        }
+    }
+    const uint64_t line_pixels = static_cast<uint64_t>(content_w / 2) * 16;
+    bench.run("tab/apply_damage/line", size.name, 1, line_pixels,
+              [&] { typing.apply_damage(*damaged, line_damage); });
+    if (!matches_page()) {
+        std::cerr << "tab/apply_damage/line: patches lost the rest of the frame" << std::endl;
+        std::abort();
+    }
+
+    // Image decoding, through a file the size of the frame
+    const char* tmpdir = std::getenv("TMPDIR");
+    std::string bmp_path = std::string(tmpdir ? tmpdir : "/tmp") + "/squ1d-ui-bench-XXXXXX";
+    const int fd = mkstemp(&bmp_path[0]);
+    if (fd < 0) {
+        std::cerr << "Cannot create a temporary BMP" << std::endl;
+        return;
+    }
+    close(fd);
+    if (write_bmp(bmp_path, w, h)) {
+        bench.run("bmp/load", size.name, 1, frame_pixels, [&] {
+            BMPLoader::Image image = BMPLoader::load(bmp_path, PixelFormat::ARGB8888);
+            if (image.pixels.empty()) {
+                std::abort();
+            }
+        });
+        BMPLoader::File file;
+        if (file.open(bmp_path)) {
+            std::vector<uint8_t> pixels(frame_pixels * 4);
+            bench.run("bmp/decode_into", size.name, 1, frame_pixels, [&] {
+                file.decode_into(pixels.data(), static_cast<size_t>(w) * 4, PixelFormat::ARGB8888);
+            });
+        }
+    }
+    std::remove(bmp_path.c_str());
+}
+
+// Tab bookkeeping does not depend on the window size
+void bench_tabs(Bench& bench) {
+    bench.run("tab_manager/open_switch_close", "-", 1, 0, [] {
+        TabManager tabs;
+        for (int i = 0; i < TEXT_TITLES; ++i) {
+            tabs.create_tab("https://example.com/" + std::to_string(i));
+        }
+        for (int i = 0; i < tabs.get_tab_count(); ++i) {
+            tabs.switch_tab(i);
+            if (!tabs.find_tab(tabs.get_active_tab()->id)) {
+                std::abort();
+            }
+        }
+        while (tabs.get_tab_count() > 1) {
+            tabs.close_tab(tabs.get_tab_count() - 1);
+        }
+    });
+}
+
+bool parse_sizes(const std::string& list, std::vector<FrameSize>& sizes) {
+    std::istringstream names(list);
+    std::string name;
+    while (std::getline(names, name, ',')) {
+        auto it = std::find_if(std::begin(FRAME_SIZES), std::end(FRAME_SIZES),
+                               [&](const FrameSize& size) { return name == size.name; });
+        if (it == std::end(FRAME_SIZES)) {
+            std::cerr << "Unknown size " << name << " (1080p, 4k or 8k)" << std::endl;
+            return false;
+        }
+        sizes.push_back(*it);
+    }
+    return !sizes.empty();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--json") == 0 && has_value) {
+            options.json_path = argv[++i];
+        } else if (std::strcmp(argv[i], "--filter") == 0 && has_value) {
+            options.filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--min-time") == 0 && has_value) {
+            options.min_time_ms = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--sizes") == 0 && has_value) {
+            if (!parse_sizes(argv[++i], options.sizes)) {
+                return 1;
+            }
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--json FILE] [--filter TEXT] [--min-time MS] [--sizes 1080p,4k,8k]" << std::endl;
+            return 1;
+        }
+    }
+    if (options.sizes.empty()) {
+        options.sizes.assign(std::begin(FRAME_SIZES), std::end(FRAME_SIZES));
+    }
+
+    Bench bench(options);
+    std::cout << "case                         size   thr" << std::endl;
+    bench_tabs(bench);
+    for (const FrameSize& size : options.sizes) {
+        bench_size(bench, size);
+    }
+
+    if (!options.json_path.empty() && !bench.write_json(options.json_path)) {
+        return 1;
+    }
+    return 0;
+}
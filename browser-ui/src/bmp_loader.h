@@ -1,99 +1,306 @@
 #pragma once
 
+#include "ui_types.h"
 #include <vector>
 #include <cstdint>
+#include <cstddef>
+#include <cstring>
 #include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-// Simple BMP loader - reads 24-bit or 32-bit BMP files into RGBA format
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define SQU1D_BMP_X86 1
+#endif
+
+// Simple BMP loader - reads 24-bit or 32-bit uncompressed BMP files.
+//
+// BMPLoader::File maps the file, validates the headers once, and decodes rows
+// straight into caller-provided memory in the requested PixelFormat, so no
+// intermediate buffer is allocated. Row swizzles use AVX2 or SSSE3 when the
+// CPU has them (picked at runtime) and fall back to scalar code.
 class BMPLoader {
 public:
     struct Image {
         uint32_t width = 0;
         uint32_t height = 0;
-        std::vector<uint8_t> pixels; // RGBA format
+        std::vector<uint8_t> pixels; // RGBA format unless requested otherwise
     };
 
-    static Image load(const std::string& path) {
-        Image img;
-        std::FILE* file = std::fopen(path.c_str(), "rb");
-        if (!file) {
-            return img; // Return empty on error
-        }
+    class File {
+    public:
+        File() = default;
+        File(const File&) = delete;
+        File& operator=(const File&) = delete;
+        ~File() { close(); }
 
-        // BMP file header (14 bytes)
-        uint8_t header[14];
-        if (std::fread(header, 1, 14, file) != 14) {
-            std::fclose(file);
-            return img;
-        }
+        // Map path and validate its headers; false if it is not a BMP we can decode
+        bool open(const std::string& path) {
+            close();
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size < 54) {
+                ::close(fd);
+                return false;
+            }
+            void* mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (mapped == MAP_FAILED) {
+                return false;
+            }
+            data = static_cast<const uint8_t*>(mapped);
+            size = static_cast<size_t>(st.st_size);
 
-        // Check signature "BM"
-        if (header[0] != 'B' || header[1] != 'M') {
-            std::fclose(file);
-            return img;
+            if (!parse_headers()) {
+                close();
+                return false;
+            }
+            return true;
         }
 
-        // DIB header (at least 40 bytes for BITMAPINFOHEADER)
-        uint8_t dib_header[40];
-        if (std::fread(dib_header, 1, 40, file) != 40) {
-            std::fclose(file);
-            return img;
+        void close() {
+            if (data) {
+                munmap(const_cast<uint8_t*>(data), size);
+            }
+            data = nullptr;
+            size = 0;
+            width_ = height_ = 0;
         }
 
-        // Parse DIB header
-        img.width = read_u32_le(&dib_header[4]);
-        img.height = read_u32_le(&dib_header[8]);
-        uint16_t bits_per_pixel = read_u16_le(&dib_header[14]);
+        uint32_t width() const { return width_; }
+        uint32_t height() const { return height_; }
 
-        // Seek to pixel data
-        uint32_t pixel_offset = read_u32_le(&header[10]);
-        std::fseek(file, pixel_offset, SEEK_SET);
+        // Decode every row into dst (height() rows of dst_stride bytes), top-down
+        bool decode_into(uint8_t* dst, size_t dst_stride, PixelFormat format) const {
+            if (!data || dst_stride < static_cast<size_t>(width_) * 4) {
+                return false;
+            }
+            RowConverter convert = pick_converter(bytes_per_pixel, format);
+            for (uint32_t y = 0; y < height_; ++y) {
+                uint32_t bmp_y = bottom_up ? height_ - 1 - y : y; // Flip vertically
+                convert(data + pixel_offset + static_cast<size_t>(bmp_y) * row_size,
+                        dst + static_cast<size_t>(y) * dst_stride, width_);
+            }
+            return true;
+        }
 
-        // Calculate row padding (BMP rows are 4-byte aligned)
-        int bytes_per_pixel = bits_per_pixel / 8;
-        int row_size = ((img.width * bits_per_pixel + 31) / 32) * 4;
-        int pixel_data_size = row_size * img.height;
+    private:
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        uint32_t width_ = 0;
+        uint32_t height_ = 0;
+        uint32_t bytes_per_pixel = 0;
+        size_t row_size = 0;
+        size_t pixel_offset = 0;
+        bool bottom_up = true;
 
-        // Allocate output buffer (RGBA)
-        img.pixels.resize(img.width * img.height * 4);
+        bool parse_headers() {
+            // Check signature "BM"
+            if (data[0] != 'B' || data[1] != 'M') {
+                return false;
+            }
 
-        // Read and convert pixel data (BMP is bottom-up, BGR format)
-        std::vector<uint8_t> bmp_data(pixel_data_size);
-        if (std::fread(bmp_data.data(), 1, pixel_data_size, file) != pixel_data_size) {
-            std::fclose(file);
-            img.pixels.clear();
-            return img;
-        }
+            // BITMAPFILEHEADER (14 bytes) followed by at least a BITMAPINFOHEADER (40 bytes)
+            const uint8_t* dib_header = data + 14;
+            const uint32_t dib_size = read_u32_le(dib_header);
+            if (dib_size < 40) {
+                return false;
+            }
+            int32_t w = static_cast<int32_t>(read_u32_le(&dib_header[4]));
+            int32_t h = static_cast<int32_t>(read_u32_le(&dib_header[8]));
+            uint16_t bits_per_pixel = read_u16_le(&dib_header[14]);
+            uint32_t compression = read_u32_le(&dib_header[16]);
+
+            // BI_RGB, or BI_BITFIELDS with the usual BGRA masks for 32-bit
+            if (w <= 0 || h == 0 || (bits_per_pixel != 24 && bits_per_pixel != 32) ||
+                !(compression == 0 || (compression == 3 && bits_per_pixel == 32 && has_bgra_masks(dib_size)))) {
+                return false;
+            }
 
-        // Convert BMP (BGR/BGRA, bottom-up) to RGBA (top-down)
-        for (uint32_t y = 0; y < img.height; ++y) {
-            uint32_t bmp_y = img.height - 1 - y; // Flip vertically
-            uint8_t* bmp_row = &bmp_data[bmp_y * row_size];
-            uint8_t* rgba_row = &img.pixels[y * img.width * 4];
+            width_ = static_cast<uint32_t>(w);
+            bottom_up = h > 0;
+            height_ = static_cast<uint32_t>(h > 0 ? h : -static_cast<int64_t>(h));
+            bytes_per_pixel = bits_per_pixel / 8;
 
-            for (uint32_t x = 0; x < img.width; ++x) {
-                uint8_t b = bmp_row[x * bytes_per_pixel];
-                uint8_t g = bmp_row[x * bytes_per_pixel + 1];
-                uint8_t r = bmp_row[x * bytes_per_pixel + 2];
-                uint8_t a = (bits_per_pixel == 32) ? bmp_row[x * bytes_per_pixel + 3] : 255;
+            // Calculate row padding (BMP rows are 4-byte aligned)
+            row_size = ((static_cast<size_t>(width_) * bits_per_pixel + 31) / 32) * 4;
+            pixel_offset = read_u32_le(&data[10]);
+            return pixel_offset <= size && row_size * height_ <= size - pixel_offset;
+        }
 
-                rgba_row[x * 4 + 0] = r;
-                rgba_row[x * 4 + 1] = g;
-                rgba_row[x * 4 + 2] = b;
-                rgba_row[x * 4 + 3] = a;
+        // The R, G, B masks follow the 40 header bytes, inside a V2+ header
+        // or after a plain one; only a V3+ header also has an alpha mask.
+        // Any other layout would need real mask decoding, so is refused.
+        bool has_bgra_masks(uint32_t dib_size) const {
+            const uint8_t* masks = data + 14 + 40;
+            const size_t mask_bytes = dib_size >= 56 ? 16 : 12;
+            if (size < 14 + 40 + mask_bytes) {
+                return false;
             }
+            return read_u32_le(masks) == 0x00FF0000u && read_u32_le(masks + 4) == 0x0000FF00u &&
+                   read_u32_le(masks + 8) == 0x000000FFu &&
+                   (mask_bytes == 12 || read_u32_le(masks + 12) == 0xFF000000u);
+        }
+    };
+
+    static Image load(const std::string& path, PixelFormat format = PixelFormat::RGBA8888) {
+        Image img;
+        File file;
+        if (!file.open(path)) {
+            return img; // Return empty on error
         }
 
-        std::fclose(file);
+        img.width = file.width();
+        img.height = file.height();
+        img.pixels.resize(static_cast<size_t>(img.width) * img.height * 4);
+        file.decode_into(img.pixels.data(), static_cast<size_t>(img.width) * 4, format);
         return img;
     }
 
 private:
+    using RowConverter = void (*)(const uint8_t* src, uint8_t* dst, uint32_t width);
+
     static uint16_t read_u16_le(const uint8_t* p) {
         return p[0] | (p[1] << 8);
     }
 
     static uint32_t read_u32_le(const uint8_t* p) {
-        return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    // Scalar converters; also handle the tails of the SIMD ones.
+    // BMP pixels are B,G,R(,A) in memory.
+    static void bgr_to_argb_scalar(const uint8_t* src, uint8_t* dst, uint32_t width) {
+        for (uint32_t x = 0; x < width; ++x) {
+            uint32_t px = 0xFF000000u | (static_cast<uint32_t>(src[x * 3 + 2]) << 16) |
+                          (static_cast<uint32_t>(src[x * 3 + 1]) << 8) | src[x * 3];
+            std::memcpy(dst + x * 4, &px, 4);
+        }
+    }
+
+    static void bgr_to_rgba_scalar(const uint8_t* src, uint8_t* dst, uint32_t width) {
+        for (uint32_t x = 0; x < width; ++x) {
+            dst[x * 4 + 0] = src[x * 3 + 2];
+            dst[x * 4 + 1] = src[x * 3 + 1];
+            dst[x * 4 + 2] = src[x * 3 + 0];
+            dst[x * 4 + 3] = 255;
+        }
+    }
+
+    static void bgra_to_argb_scalar(const uint8_t* src, uint8_t* dst, uint32_t width) {
+        for (uint32_t x = 0; x < width; ++x) {
+            uint32_t px = (static_cast<uint32_t>(src[x * 4 + 3]) << 24) | (static_cast<uint32_t>(src[x * 4 + 2]) << 16) |
+                          (static_cast<uint32_t>(src[x * 4 + 1]) << 8) | src[x * 4];
+            std::memcpy(dst + x * 4, &px, 4);
+        }
+    }
+
+    static void bgra_to_rgba_scalar(const uint8_t* src, uint8_t* dst, uint32_t width) {
+        for (uint32_t x = 0; x < width; ++x) {
+            dst[x * 4 + 0] = src[x * 4 + 2];
+            dst[x * 4 + 1] = src[x * 4 + 1];
+            dst[x * 4 + 2] = src[x * 4 + 0];
+            dst[x * 4 + 3] = src[x * 4 + 3];
+        }
+    }
+
+#ifdef SQU1D_BMP_X86
+    // Byte shuffles for 4 pixels per 128-bit lane; -1 zeroes the byte so the
+    // alpha can be OR-ed in afterwards.
+    static __m128i shuffle_bgr_to_argb() { return _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1); }
+    static __m128i shuffle_bgr_to_rgba() { return _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1); }
+    static __m128i shuffle_bgra_to_rgba() { return _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15); }
+
+    // 24-bit rows: each 16-byte load covers 4 pixels plus 4 bytes of the next,
+    // so stop while 2 whole pixels remain and let the scalar tail finish.
+    template <bool ToArgb>
+    __attribute__((target("ssse3")))
+    static void bgr_row_ssse3(const uint8_t* src, uint8_t* dst, uint32_t width) {
+        const __m128i shuffle = ToArgb ? shuffle_bgr_to_argb() : shuffle_bgr_to_rgba();
+        const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+        uint32_t x = 0;
+        for (; x + 6 <= width; x += 4) {
+            __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 3));
+            __m128i out = _mm_or_si128(_mm_shuffle_epi8(in, shuffle), alpha);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), out);
+        }
+        (ToArgb ? bgr_to_argb_scalar : bgr_to_rgba_scalar)(src + x * 3, dst + x * 4, width - x);
+    }
+
+    __attribute__((target("ssse3")))
+    static void bgra_to_rgba_ssse3(const uint8_t* src, uint8_t* dst, uint32_t width) {
+        const __m128i shuffle = shuffle_bgra_to_rgba();
+        uint32_t x = 0;
+        for (; x + 4 <= width; x += 4) {
+            __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 4), _mm_shuffle_epi8(in, shuffle));
+        }
+        bgra_to_rgba_scalar(src + x * 4, dst + x * 4, width - x);
+    }
+
+    template <bool ToArgb>
+    __attribute__((target("avx2")))
+    static void bgr_row_avx2(const uint8_t* src, uint8_t* dst, uint32_t width) {
+        const __m128i lane = ToArgb ? shuffle_bgr_to_argb() : shuffle_bgr_to_rgba();
+        const __m256i shuffle = _mm256_broadcastsi128_si256(lane);
+        const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000u));
+        uint32_t x = 0;
+        // 8 pixels = 24 source bytes, split across the two 128-bit lanes
+        for (; x + 10 <= width; x += 8) {
+            const uint8_t* p = src + x * 3;
+            __m256i in = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))),
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 12)), 1);
+            __m256i out = _mm256_or_si256(_mm256_shuffle_epi8(in, shuffle), alpha);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 4), out);
+        }
+        bgr_row_ssse3<ToArgb>(src + x * 3, dst + x * 4, width - x);
+    }
+
+    __attribute__((target("avx2")))
+    static void bgra_to_rgba_avx2(const uint8_t* src, uint8_t* dst, uint32_t width) {
+        const __m256i shuffle = _mm256_broadcastsi128_si256(shuffle_bgra_to_rgba());
+        uint32_t x = 0;
+        for (; x + 8 <= width; x += 8) {
+            __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x * 4));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x * 4), _mm256_shuffle_epi8(in, shuffle));
+        }
+        bgra_to_rgba_scalar(src + x * 4, dst + x * 4, width - x);
+    }
+#endif
+
+    static void bgra_to_argb_copy(const uint8_t* src, uint8_t* dst, uint32_t width) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        std::memcpy(dst, src, static_cast<size_t>(width) * 4); // identical byte order
+#else
+        bgra_to_argb_scalar(src, dst, width);
+#endif
+    }
+
+    static RowConverter pick_converter(uint32_t bytes_per_pixel, PixelFormat format) {
+        const bool to_argb = format == PixelFormat::ARGB8888;
+        if (bytes_per_pixel == 4 && to_argb) {
+            return bgra_to_argb_copy;
+        }
+#ifdef SQU1D_BMP_X86
+        static const bool has_avx2 = __builtin_cpu_supports("avx2");
+        static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+        if (has_avx2) {
+            if (bytes_per_pixel == 4) return bgra_to_rgba_avx2;
+            return to_argb ? bgr_row_avx2<true> : bgr_row_avx2<false>;
+        }
+        if (has_ssse3) {
+            if (bytes_per_pixel == 4) return bgra_to_rgba_ssse3;
+            return to_argb ? bgr_row_ssse3<true> : bgr_row_ssse3<false>;
+        }
+#endif
+        if (bytes_per_pixel == 4) return bgra_to_rgba_scalar;
+        return to_argb ? bgr_to_argb_scalar : bgr_to_rgba_scalar;
     }
 };
@@ -1,45 +1,166 @@
 #include "browser_window.h"
+#include "present.h"
 #include <SDL2/SDL.h>
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <unistd.h>
 
-BrowserWindow::BrowserWindow(int width, int height, const std::string& title)
-    : window_width(width), window_height(height), running(true),
-      history_index(0), url_bar_focused(false) {
+namespace {
+
+// Upper bound on how long an idle window sleeps between checks
+constexpr int IDLE_WAIT_MS = 500;
+
+// Tabs are re-rendered once the window has gone this long without a resize
+constexpr uint32_t RESIZE_SETTLE_MS = 150;
+
+// Changes reach the session file at most this often
+constexpr uint32_t SESSION_SYNC_MS = 1000;
+
+// How long a script's idle command waits for renders by default
+constexpr uint32_t SCRIPT_IDLE_TIMEOUT_MS = 10000;
+
+// Display list ids of the chrome, in paint order. Every element takes a
+// block of CHROME_ID_STRIDE ids; tab i uses CHROME_TABS + i * CHROME_ID_STRIDE.
+constexpr uint32_t CHROME_ID_STRIDE = 16;
+constexpr uint32_t CHROME_TOOLBAR = 1 * CHROME_ID_STRIDE;
+constexpr uint32_t CHROME_BACK = 2 * CHROME_ID_STRIDE;
+constexpr uint32_t CHROME_FORWARD = 3 * CHROME_ID_STRIDE;
+constexpr uint32_t CHROME_REFRESH = 4 * CHROME_ID_STRIDE;
+constexpr uint32_t CHROME_URL_BAR = 5 * CHROME_ID_STRIDE;
+constexpr uint32_t CHROME_NEW_TAB = 6 * CHROME_ID_STRIDE;
+constexpr uint32_t CHROME_TABS = 16 * CHROME_ID_STRIDE;
+// Overview cell i uses CHROME_OVERVIEW + i * CHROME_ID_STRIDE, past any tab
+constexpr uint32_t CHROME_OVERVIEW = 1u << 24;
+
+const Color CHROME_BACKGROUND = Color(255, 255, 255);
+
+// Frame-time HUD, at the top right of the content area
+constexpr int HUD_WIDTH = 150;
+constexpr float HUD_FONT_SIZE = 11.0f;
+const Color HUD_BACKGROUND = Color(0, 0, 0, 170);
+const Color HUD_TEXT = Color(255, 255, 255);
+
+// Tab overview grid. Cells keep the content area's aspect; they get a
+// caption with the tab's title when they are wide enough for one.
+constexpr int OVERVIEW_GAP = 8;
+constexpr int OVERVIEW_CAPTION_HEIGHT = 25;
+constexpr int OVERVIEW_MIN_CAPTIONED_WIDTH = 80;
+const Color OVERVIEW_PLACEHOLDER = Color(225, 225, 225);
+const Color OVERVIEW_ACTIVE = Color(100, 150, 255);
+
+// Set by SIGUSR1; the event loop writes the trace on its next pass
+volatile std::sig_atomic_t trace_dump_requested = 0;
+
+void request_trace_dump(int) {
+    trace_dump_requested = 1;
+}
+
+bool dump_trace(const std::string& path) {
+    if (!Trace::ENABLED) {
+        std::cerr << "Tracing was compiled out (SQU1D_TRACING)" << std::endl;
+        return false;
+    }
+    if (!Trace::write_chrome_json(path)) {
+        return false;
+    }
+    std::cout << "Wrote frame trace to " << path << std::endl;
+    return true;
+}
+
+// squ1d-trace-<pid>-<n>.json in the working directory
+std::string next_trace_path() {
+    static int dumps = 0;
+    return "squ1d-trace-" + std::to_string(getpid()) + "-" + std::to_string(++dumps) + ".json";
+}
+
+} // namespace
+
+BrowserWindow::BrowserWindow(int width, int height, const std::string& title, bool headless)
+    : window(nullptr), surface(nullptr), window_width(width), window_height(height), running(true),
+      headless(headless), needs_redraw(true), render_event_type(0),
+      url_bar_focused(false),
+      content_damage_full(true), presented_tab_id(0), presented_content{0, 0, 0, 0},
+      resize_pending(false), resize_settle_at(0), hud_visible(false), hud_presented{0, 0, 0, 0},
+      overview_visible(false), overview_caption_height(0), session_active_id(0), session_sync_at(0) {
     
-    // Initialize SDL
-    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+    // Initialize SDL; headless runs only need the event queue
+    if (SDL_Init(headless ? SDL_INIT_EVENTS : SDL_INIT_VIDEO) < 0) {
         std::cerr << "SDL initialization failed: " << SDL_GetError() << std::endl;
         running = false;
         return;
     }
     
     // Create window
-    window = SDL_CreateWindow(
-        title.c_str(),
-        SDL_WINDOWPOS_CENTERED,
-        SDL_WINDOWPOS_CENTERED,
-        width,
-        height,
-        SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE
-    );
+    if (!headless) {
+        window = SDL_CreateWindow(
+            title.c_str(),
+            SDL_WINDOWPOS_CENTERED,
+            SDL_WINDOWPOS_CENTERED,
+            width,
+            height,
+            SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE
+        );
+
+        if (!window) {
+            std::cerr << "Window creation failed: " << SDL_GetError() << std::endl;
+            running = false;
+            return;
+        }
+    }
     
-    if (!window) {
-        std::cerr << "Window creation failed: " << SDL_GetError() << std::endl;
+    acquire_surface();
+    if (!surface) {
+        std::cerr << "Surface creation failed: " << SDL_GetError() << std::endl;
         running = false;
         return;
     }
     
-    surface = SDL_GetWindowSurface(window);
-    
     // Initialize components
     tab_manager = std::make_unique<TabManager>();
+    raster_pool = std::make_unique<WorkStealingPool>();
     ui_renderer = std::make_unique<UIRenderer>(width, height);
+    ui_renderer->set_thread_pool(raster_pool.get());
+    tab_manager->set_thread_pool(raster_pool.get());
     renderer_bridge = std::make_unique<RendererBridge>();
+    thumbnails = std::make_unique<ThumbnailCache>();
+
+    // Wake the event loop when a render or thumbnail lands; SDL_PushEvent
+    // is thread-safe
+    render_event_type = SDL_RegisterEvents(1);
+    if (render_event_type != static_cast<uint32_t>(-1)) {
+        const uint32_t type = render_event_type;
+        auto wake = [type] {
+            SDL_Event event;
+            SDL_zero(event);
+            event.type = type;
+            SDL_PushEvent(&event);
+        };
+        renderer_bridge->set_completion_notifier(wake);
+        thumbnails->set_completion_notifier(wake);
+    }
     
     current_url = "https://google.com";
+
+    Trace::set_thread_name("ui");
+    if (Trace::ENABLED) {
+        std::signal(SIGUSR1, request_trace_dump);
+    }
 }
 
 BrowserWindow::~BrowserWindow() {
+    if (session) {
+        sync_session();
+        session.reset(); // writes what is still queued
+    }
+    renderer_bridge.reset(); // no completion events once SDL is gone
+    thumbnails.reset();
+    if (headless && surface) {
+        SDL_FreeSurface(surface);
+    }
     if (window) {
         SDL_DestroyWindow(window);
     }
@@ -48,43 +169,415 @@ BrowserWindow::~BrowserWindow() {
 
 void BrowserWindow::run() {
     while (running) {
+        step(IDLE_WAIT_MS);
+    }
+}
+
+void BrowserWindow::step(int max_wait_ms) {
+    if (trace_dump_requested) {
+        trace_dump_requested = 0;
+        dump_trace(next_trace_path());
+    }
+
+    // Sleep until something happens unless a frame is already owed
+    SDL_Event event;
+    int wait_ms = max_wait_ms;
+    if (resize_pending) {
+        const int32_t left = static_cast<int32_t>(resize_settle_at - SDL_GetTicks());
+        wait_ms = std::clamp(left, 0, max_wait_ms);
+    }
+    const bool woken = !needs_redraw && SDL_WaitEventTimeout(&event, wait_ms);
+    {
+        TRACE_SCOPE("handle_events");
+        if (woken) {
+            handle_event(event);
+        }
         handle_events();
+    }
+    if (resize_pending && SDL_TICKS_PASSED(SDL_GetTicks(), resize_settle_at)) {
+        resize_pending = false;
+        rerender_after_resize();
+    }
+    process_render_completions();
+    if (thumbnails->collect() && overview_visible) {
+        needs_redraw = true;
+    }
+
+    if (needs_redraw) {
+        TRACE_SCOPE("frame");
+        needs_redraw = false;
+        const uint64_t start = Trace::now_ns();
         update_display();
         render_frame();
-        SDL_Delay(16); // ~60 FPS
+        frame_stats.add((Trace::now_ns() - start) / 1e6);
+
+        // After the frame is out, so compressing tabs never delays one
+        tab_manager->enforce_memory_budget();
+    }
+
+    if (session && SDL_TICKS_PASSED(SDL_GetTicks(), session_sync_at)) {
+        session_sync_at = SDL_GetTicks() + SESSION_SYNC_MS;
+        sync_session();
+    }
+}
+
+void BrowserWindow::open_session(const std::string& path) {
+    SavedSession saved;
+    if (SessionStore::load(path, saved)) {
+        // The saved tabs replace the initial one. None renders yet: the
+        // active tab loads its saved frame and renders below, the others
+        // when first shown.
+        for (const auto& saved_tab : saved.tabs) {
+            auto tab = tab_manager->create_tab(saved_tab.url);
+            tab->set_title(saved_tab.title);
+            for (const auto& url : saved_tab.history) {
+                tab->history.push_back(HistoryEntry{url, "", nullptr, CompressedPixels()});
+            }
+            tab->history_index = saved_tab.history_index;
+            tab->content_discarded = true;
+            if (!saved_tab.frame.empty()) {
+                saved_frames[tab->id] = saved_tab.frame;
+            }
+        }
+        auto initial = tab_manager->get_tab(0);
+        if (initial->pending_render != 0) {
+            renderer_bridge->cancel_render(initial->pending_render);
+        }
+        renderer_bridge->forget_tab(initial->id);
+        tab_manager->close_tab(0);
+        activate_tab(saved.active_index);
+        current_url = tab_manager->get_active_tab()->url;
+    }
+
+    // The store starts the file afresh, with the saved frames carried over
+    // as they are
+    session = std::make_unique<SessionStore>(path);
+    for (size_t i = 0; i < saved.tabs.size(); ++i) {
+        const auto tab = tab_manager->get_tab(static_cast<int>(i));
+        const SavedTab& saved_tab = saved.tabs[i];
+        session->save_tab(tab->id, tab->url, tab->title, saved_tab.history, saved_tab.history_index);
+        session->save_frame(tab->id, saved_tab.frame);
+        session_tabs[tab->id] =
+            SessionTabState{tab->url, tab->title, saved_tab.history, saved_tab.history_index, tab->content_version};
+    }
+    sync_session();
+}
+
+void BrowserWindow::sync_session() {
+    TRACE_SCOPE("sync_session");
+    auto same_history = [](const Tab& tab, const SessionTabState& state) {
+        if (tab.history_index != state.history_index || tab.history.size() != state.history.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < tab.history.size(); ++i) {
+            if (tab.history[i].url != state.history[i]) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    for (const auto& tab : tab_manager->get_tabs()) {
+        auto known = session_tabs.find(tab->id);
+        if (known == session_tabs.end()) {
+            known = session_tabs.emplace(tab->id, SessionTabState{"", "", {}, -1, 0}).first;
+        }
+        SessionTabState& state = known->second;
+        if (state.url.empty() || state.url != tab->url || state.title != tab->title ||
+            !same_history(*tab, state)) {
+            state.url = tab->url;
+            state.title = tab->title;
+            state.history.clear();
+            for (const auto& entry : tab->history) {
+                state.history.push_back(entry.url);
+            }
+            state.history_index = tab->history_index;
+            session->save_tab(tab->id, state.url, state.title, state.history, state.history_index);
+        }
+
+        // A frame compressed since it landed is saved as it is
+        if (tab->content_version != state.content_version) {
+            if (tab->is_resident()) {
+                session->save_frame(tab->id, tab->rendered_content);
+            } else if (!tab->compressed_content.empty()) {
+                session->save_frame(tab->id, tab->compressed_content);
+            }
+            state.content_version = tab->content_version;
+        }
+    }
+    for (auto it = session_tabs.begin(); it != session_tabs.end();) {
+        if (!tab_manager->find_tab(it->first)) {
+            session->close_tab(it->first);
+            it = session_tabs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    auto active_tab = tab_manager->get_active_tab();
+    const int active_id = active_tab ? active_tab->id : 0;
+    if (active_id != session_active_id) {
+        session->save_window(active_id);
+        session_active_id = active_id;
     }
 }
 
+bool BrowserWindow::busy() const {
+    if (resize_pending || needs_redraw || !thumbnails->idle()) {
+        return true;
+    }
+    for (const auto& tab : tab_manager->get_tabs()) {
+        if (tab->pending_render != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void BrowserWindow::acquire_surface() {
+    if (window) {
+        surface = SDL_GetWindowSurface(window); // the old one is freed on resize
+        return;
+    }
+
+    // Headless: draw into memory, in the layout the present path copies
+    // straight into
+    if (surface) {
+        SDL_FreeSurface(surface);
+    }
+    surface = SDL_CreateRGBSurfaceWithFormat(0, window_width, window_height, 32, SDL_PIXELFORMAT_ARGB8888);
+}
+
+bool BrowserWindow::run_script(const std::string& path) {
+    std::ifstream script(path);
+    if (!script) {
+        std::cerr << "Cannot open script " << path << std::endl;
+        return false;
+    }
+
+    // Start from a fully drawn window. A shown window gets this from its
+    // first expose; an offscreen one never sees one.
+    SDL_Event expose;
+    SDL_zero(expose);
+    expose.type = SDL_WINDOWEVENT;
+    expose.window.event = SDL_WINDOWEVENT_EXPOSED;
+    handle_event(expose);
+    step(0);
+
+    std::string line;
+    int line_number = 0;
+    while (running && std::getline(script, line)) {
+        ++line_number;
+        line = line.substr(0, line.find('#'));
+        std::istringstream args(line);
+        std::string command;
+        if (!(args >> command)) {
+            continue;
+        }
+        if (!run_command(command, args)) {
+            std::cerr << path << ":" << line_number << ": failed: " << line << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BrowserWindow::run_command(const std::string& command, std::istringstream& args) {
+    // Input goes through handle_event() like real events, then the loop
+    // runs once so it shows up on screen
+    SDL_Event event;
+    SDL_zero(event);
+
+    if (command == "navigate") {
+        std::string url;
+        if (!(args >> url)) {
+            return false;
+        }
+        navigate_to(url);
+        needs_redraw = true;
+    } else if (command == "click") {
+        int x, y;
+        if (!(args >> x >> y)) {
+            return false;
+        }
+        event.type = SDL_MOUSEBUTTONDOWN;
+        event.button.button = SDL_BUTTON_LEFT;
+        event.button.x = x;
+        event.button.y = y;
+        handle_event(event);
+    } else if (command == "key") {
+        std::string name;
+        if (!(args >> name)) {
+            return false;
+        }
+        const SDL_Keycode key = SDL_GetKeyFromName(name.c_str());
+        if (key == SDLK_UNKNOWN) {
+            return false;
+        }
+        event.type = SDL_KEYDOWN;
+        event.key.keysym.sym = key;
+        handle_event(event);
+    } else if (command == "resize") {
+        int w, h;
+        if (!(args >> w >> h) || w <= 0 || h <= 0) {
+            return false;
+        }
+        event.type = SDL_WINDOWEVENT;
+        event.window.event = SDL_WINDOWEVENT_RESIZED;
+        event.window.data1 = w;
+        event.window.data2 = h;
+        handle_event(event);
+        if (!surface) {
+            return false;
+        }
+    } else if (command == "wait") {
+        int ms;
+        if (!(args >> ms) || ms < 0) {
+            return false;
+        }
+        const uint32_t until = SDL_GetTicks() + ms;
+        while (running && !SDL_TICKS_PASSED(SDL_GetTicks(), until)) {
+            step(std::clamp(static_cast<int32_t>(until - SDL_GetTicks()), 0, IDLE_WAIT_MS));
+        }
+    } else if (command == "idle") {
+        int timeout_ms = SCRIPT_IDLE_TIMEOUT_MS;
+        args >> timeout_ms;
+        const uint32_t until = SDL_GetTicks() + std::max(0, timeout_ms);
+        while (running && busy()) {
+            if (SDL_TICKS_PASSED(SDL_GetTicks(), until)) {
+                std::cerr << "Still busy after " << timeout_ms << " ms" << std::endl;
+                return false;
+            }
+            step(std::clamp(static_cast<int32_t>(until - SDL_GetTicks()), 0, IDLE_WAIT_MS));
+        }
+    } else if (command == "frame") {
+        std::string frame_path;
+        if (!(args >> frame_path)) {
+            return false;
+        }
+        step(0);
+        if (SDL_SaveBMP(surface, frame_path.c_str()) < 0) {
+            std::cerr << "Cannot save " << frame_path << ": " << SDL_GetError() << std::endl;
+            return false;
+        }
+    } else if (command == "hud") {
+        std::string state;
+        if (!(args >> state) || (state != "on" && state != "off")) {
+            return false;
+        }
+        hud_visible = state == "on";
+        needs_redraw = true;
+    } else if (command == "overview") {
+        std::string state;
+        if (!(args >> state) || (state != "on" && state != "off")) {
+            return false;
+        }
+        overview_visible = state == "on";
+        needs_redraw = true;
+    } else if (command == "trace") {
+        std::string trace_path;
+        if (!(args >> trace_path)) {
+            return false;
+        }
+        if (!dump_trace(trace_path)) {
+            return false;
+        }
+    } else if (command == "repaint") {
+        int frames;
+        if (!(args >> frames) || frames <= 0) {
+            return false;
+        }
+        const double ticks_per_ms = SDL_GetPerformanceFrequency() / 1000.0;
+        double total_ms = 0;
+        double worst_ms = 0;
+        for (int i = 0; i < frames; ++i) {
+            chrome.invalidate(PixelRect{0, 0, window_width, window_height});
+            content_damage_full = true;
+            const uint64_t start = SDL_GetPerformanceCounter();
+            update_display();
+            render_frame();
+            const double ms = (SDL_GetPerformanceCounter() - start) / ticks_per_ms;
+            frame_stats.add(ms);
+            total_ms += ms;
+            worst_ms = std::max(worst_ms, ms);
+        }
+        std::cout << "repaint " << window_width << "x" << window_height << ": " << frames << " frames, mean "
+                  << total_ms / frames << " ms, max " << worst_ms << " ms" << std::endl;
+    } else {
+        return false;
+    }
+
+    step(0);
+    return true;
+}
+
 void BrowserWindow::handle_events() {
     SDL_Event event;
     while (SDL_PollEvent(&event)) {
-        switch (event.type) {
-            case SDL_QUIT:
-                running = false;
-                break;
-            
-            case SDL_MOUSEBUTTONDOWN:
-                if (event.button.button == SDL_BUTTON_LEFT) {
-                    handle_mouse_click(event.button.x, event.button.y);
-                }
-                break;
-            
-            case SDL_KEYDOWN:
-                handle_key_press(event.key.keysym.sym);
-                break;
-            
-            case SDL_WINDOWEVENT:
-                if (event.window.event == SDL_WINDOWEVENT_RESIZED) {
-                    window_width = event.window.data1;
-                    window_height = event.window.data2;
-                    ui_renderer = std::make_unique<UIRenderer>(window_width, window_height);
-                }
-                break;
-        }
+        handle_event(event);
+    }
+}
+
+void BrowserWindow::handle_event(const SDL_Event& event) {
+    switch (event.type) {
+        case SDL_QUIT:
+            running = false;
+            break;
+        
+        case SDL_MOUSEBUTTONDOWN:
+            if (event.button.button == SDL_BUTTON_LEFT) {
+                handle_mouse_click(event.button.x, event.button.y);
+                needs_redraw = true;
+            }
+            break;
+        
+        case SDL_KEYDOWN:
+            handle_key_press(event.key.keysym.sym);
+            needs_redraw = true;
+            break;
+        
+        case SDL_WINDOWEVENT:
+            if (event.window.event == SDL_WINDOWEVENT_RESIZED) {
+                window_width = event.window.data1;
+                window_height = event.window.data2;
+                ui_renderer->resize(window_width, window_height);
+                acquire_surface();
+                chrome.invalidate(PixelRect{0, 0, window_width, window_height});
+                content_damage_full = true;
+                needs_redraw = true;
+
+                // Re-render once the drag settles; until then the old
+                // content is shown scaled to the new size
+                resize_pending = true;
+                resize_settle_at = SDL_GetTicks() + RESIZE_SETTLE_MS;
+            } else if (event.window.event == SDL_WINDOWEVENT_EXPOSED) {
+                chrome.invalidate(PixelRect{0, 0, window_width, window_height});
+                content_damage_full = true;
+                needs_redraw = true;
+            }
+            break;
+
+        default:
+            // render_event_type only wakes the loop; run() drains completions
+            break;
     }
 }
 
 void BrowserWindow::handle_mouse_click(float x, float y) {
+    // The overview covers the content area; picking a tab closes it
+    if (overview_visible && y >= 85) {
+        for (size_t i = 0; i < overview_cells.size(); ++i) {
+            const PixelRect& cell = overview_cells[i];
+            if (x >= cell.x && x < cell.x + cell.width && y >= cell.y &&
+                y < cell.y + cell.height + overview_caption_height) {
+                activate_tab(static_cast<int>(i));
+                overview_visible = false;
+                break;
+            }
+        }
+        return;
+    }
+
     // Check if clicking on toolbar buttons or tabs
     // Back button: (10, 10) to (45, 40)
     if (x >= 10 && x < 45 && y >= 10 && y < 40) {
@@ -113,15 +606,61 @@ void BrowserWindow::handle_mouse_click(float x, float y) {
     // New tab button: (window_width - 50, 10) to (window_width - 10, 40)
     if (x >= window_width - 50 && x < window_width - 10 && y >= 10 && y < 40) {
         auto new_tab = tab_manager->create_tab("https://google.com");
-        tab_manager->switch_tab(tab_manager->get_tab_count() - 1);
+        activate_tab(tab_manager->get_tab_count() - 1);
+        return;
+    }
+
+    // Tab strip: 100x25 tabs from (10, 55), 105 apart
+    if (x >= 10 && y >= 55 && y < 80) {
+        const int index = static_cast<int>((x - 10) / 105);
+        if (x - 10 - index * 105 < 100 && index < tab_manager->get_tab_count()) {
+            activate_tab(index);
+        }
         return;
     }
 }
 
+void BrowserWindow::activate_tab(int index) {
+    tab_manager->switch_tab(index);
+
+    // A tab whose frame was dropped to save memory renders again, as does
+    // one restored from the session, over its saved frame
+    auto tab = tab_manager->get_active_tab();
+    if (!tab) {
+        return;
+    }
+    const bool restored = load_saved_frame(*tab);
+    if ((restored || (tab->content_discarded && !tab->has_content())) && tab->pending_render == 0) {
+        tab->pending_render =
+            renderer_bridge->submit_render(tab->id, tab->url, window_width - 20, window_height - 95);
+    }
+}
+
+bool BrowserWindow::load_saved_frame(Tab& tab) {
+    auto saved = saved_frames.find(tab.id);
+    if (saved == saved_frames.end()) {
+        return false;
+    }
+    CompressedPixels frame;
+    if (saved->second.load(frame)) {
+        tab.set_compressed_content(std::move(frame));
+        if (tab.restore_content(raster_pool.get())) {
+            thumbnails->update(tab.id, tab.rendered_content);
+        }
+        auto state = session_tabs.find(tab.id);
+        if (state != session_tabs.end()) {
+            state->second.content_version = tab.content_version; // the file has it already
+        }
+    }
+    saved_frames.erase(saved);
+    return true;
+}
+
 void BrowserWindow::handle_key_press(int key) {
     switch (key) {
         case SDLK_ESCAPE:
             url_bar_focused = false;
+            overview_visible = false;
             break;
         
         case SDLK_RETURN:
@@ -131,10 +670,32 @@ void BrowserWindow::handle_key_press(int key) {
             }
             break;
         
+        case SDLK_F9:
+            overview_visible = !overview_visible;
+            break;
+
+        case SDLK_F10:
+            hud_visible = !hud_visible;
+            break;
+
+        case SDLK_F12:
+            dump_trace(next_trace_path());
+            break;
+
         case SDLK_w:
             // Cmd+W to close tab (would need modifier detection)
             if (tab_manager->get_tab_count() > 0) {
+                auto closing = tab_manager->get_active_tab();
+                if (closing && closing->pending_render != 0) {
+                    renderer_bridge->cancel_render(closing->pending_render);
+                }
+                if (closing) {
+                    renderer_bridge->forget_tab(closing->id);
+                    thumbnails->remove(closing->id);
+                    saved_frames.erase(closing->id);
+                }
                 tab_manager->close_tab(tab_manager->get_active_index());
+                activate_tab(tab_manager->get_active_index());
             }
             break;
     }
@@ -142,73 +703,144 @@ void BrowserWindow::handle_key_press(int key) {
 
 void BrowserWindow::navigate_to(const std::string& url) {
     current_url = url;
-    history.push_back(url);
-    history_index = history.size() - 1;
-    
     auto active_tab = tab_manager->get_active_tab();
     if (active_tab) {
-        active_tab->url = url;
-        active_tab->set_title("Loading...");
-        active_tab->rendered_content.clear(); // Force re-render
-        
-        // Request render from bridge with delay consideration
-        int content_width = window_width - 20;
-        int content_height = window_height - 95;
-        renderer_bridge->request_render(url, content_width, content_height);
-        
-        // Load the rendered content immediately
-        auto rendered = renderer_bridge->get_rendered_content();
-        if (!rendered.empty()) {
-            active_tab->set_content(rendered);
-            active_tab->set_title(url); // Update title once rendered
+        active_tab->push_history(url);
+        load_page(*active_tab);
+    }
+}
+
+void BrowserWindow::load_page(Tab& tab) {
+    tab.set_title("Loading...");
+
+    // Render on the bridge's worker thread; this replaces (and cancels)
+    // any navigation still pending in this tab. The result is picked up
+    // by process_render_completions() on a later frame. The old content
+    // stays up until then, and lets the renderer send only what changed.
+    int content_width = window_width - 20;
+    int content_height = window_height - 95;
+    tab.pending_render =
+        renderer_bridge->submit_render(tab.id, tab.url, content_width, content_height, tab.content_job);
+}
+
+void BrowserWindow::process_render_completions() {
+    TRACE_SCOPE("process_render_completions");
+    render_completions.clear();
+    renderer_bridge->poll_completions(render_completions);
+
+    for (auto& completion : render_completions) {
+        auto tab = tab_manager->find_tab(completion.tab_id);
+        if (!tab || tab->pending_render != completion.job_id) {
+            continue; // tab closed or navigated again since
+        }
+
+        tab->pending_render = 0;
+        needs_redraw = true;
+        if (!completion.ok) {
+            continue;
         }
+
+        if (completion.partial) {
+            if (tab->content_job != completion.base_job_id ||
+                !tab->apply_damage(*completion.frame, completion.damage)) {
+                // Our copy no longer matches the renderer's: ask for a whole frame
+                tab->pending_render = renderer_bridge->submit_render(
+                    tab->id, completion.url, completion.width, completion.height);
+                continue;
+            }
+            if (tab->is_active) {
+                content_damage.insert(content_damage.end(), completion.damage.begin(), completion.damage.end());
+            }
+        } else {
+            tab->set_content(std::move(completion.frame));
+            if (tab->is_active) {
+                content_damage_full = true;
+            }
+        }
+        tab->content_job = completion.job_id;
+        tab->set_title(completion.url); // Update title once rendered
+        thumbnails->update(tab->id, tab->rendered_content);
     }
 }
 
-void BrowserWindow::go_back() {
-    if (history_index > 0) {
-        history_index--;
-        current_url = history[history_index];
-        navigate_to(current_url);
+void BrowserWindow::rerender_after_resize() {
+    // One render per tab at the settled size. Renders still in flight were
+    // asked for at some earlier size, so they are replaced too.
+    const int content_width = window_width - 20;
+    const int content_height = window_height - 95;
+    for (auto& tab : tab_manager->get_tabs()) {
+        const bool stale = tab->has_content() &&
+                           (tab->content_width != content_width || tab->content_height != content_height);
+        if (stale || tab->pending_render != 0) {
+            tab->pending_render = renderer_bridge->submit_render(tab->id, tab->url, content_width, content_height,
+                                                                 tab->content_job);
+        }
     }
 }
 
+void BrowserWindow::go_back() {
+    step_history(-1);
+}
+
 void BrowserWindow::go_forward() {
-    if (history_index < static_cast<int>(history.size()) - 1) {
-        history_index++;
-        current_url = history[history_index];
-        navigate_to(current_url);
+    step_history(1);
+}
+
+void BrowserWindow::step_history(int delta) {
+    auto tab = tab_manager->get_active_tab();
+    if (!tab || !tab->can_step_history(delta)) {
+        return;
+    }
+    if (tab->pending_render != 0) {
+        renderer_bridge->cancel_render(tab->pending_render);
+        tab->pending_render = 0;
+    }
+
+    // A cached entry is shown as it was, without asking the renderer; it
+    // renders again only if the window was resized since
+    const bool cached = tab->step_history(delta, raster_pool.get());
+    current_url = tab->url;
+    if (cached) {
+        content_damage_full = true;
+        thumbnails->update(tab->id, tab->rendered_content);
+    }
+    if (!cached || tab->content_width != window_width - 20 || tab->content_height != window_height - 95) {
+        load_page(*tab);
     }
 }
 
 void BrowserWindow::refresh() {
-    navigate_to(current_url);
+    auto active_tab = tab_manager->get_active_tab();
+    if (active_tab && active_tab->history_index >= 0) {
+        load_page(*active_tab);
+    } else {
+        navigate_to(current_url);
+    }
 }
 
 void BrowserWindow::update_display() {
-    // Clear and redraw everything
-    ui_renderer->clear(Color(255, 255, 255));
-    
-    // Draw toolbar
-    ui_renderer->draw_toolbar(50);
+    TRACE_SCOPE("update_display");
+    // Re-state the chrome; only items that changed are repainted
+    chrome.begin();
+    chrome.add_toolbar(CHROME_TOOLBAR, window_width, 50);
     
     // Draw navigation buttons
     Rect back_btn(10, 10, 30, 30);
-    ui_renderer->draw_button(back_btn, "←");
+    chrome.add_button(CHROME_BACK, back_btn, "←");
     
     Rect forward_btn(50, 10, 30, 30);
-    ui_renderer->draw_button(forward_btn, "→");
+    chrome.add_button(CHROME_FORWARD, forward_btn, "→");
     
     Rect refresh_btn(90, 10, 30, 30);
-    ui_renderer->draw_button(refresh_btn, "⟳");
+    chrome.add_button(CHROME_REFRESH, refresh_btn, "⟳");
     
     // Draw URL bar
     Rect url_bar(130, 10, window_width - 190, 30);
-    ui_renderer->draw_url_bar(url_bar, current_url, url_bar_focused);
+    chrome.add_url_bar(CHROME_URL_BAR, url_bar, current_url, url_bar_focused);
     
     // Draw new tab button
     Rect new_tab_btn(window_width - 50, 10, 40, 30);
-    ui_renderer->draw_button(new_tab_btn, "+");
+    chrome.add_button(CHROME_NEW_TAB, new_tab_btn, "+");
     
     // Draw tabs
     float tab_x = 10;
@@ -216,66 +848,266 @@ void BrowserWindow::update_display() {
         auto tab = tab_manager->get_tab(i);
         if (tab) {
             Rect tab_rect(tab_x, 55, 100, 25);
-            ui_renderer->draw_tab(tab_rect, tab->title, tab->is_active);
+            chrome.add_tab(CHROME_TABS + i * CHROME_ID_STRIDE, tab_rect, tab->title, tab->is_active);
             tab_x += 105;
         }
     }
+    if (overview_visible) {
+        add_overview();
+    } else {
+        overview_cells.clear();
+    }
+    chrome.end();
+
+    // Area the tab content no longer covers falls back to the chrome
+    auto active_tab = tab_manager->get_active_tab();
+    PixelRect shown = visible_content_rect();
+    if ((active_tab ? active_tab->id : 0) != presented_tab_id || shown.width < presented_content.width ||
+        shown.height < presented_content.height) {
+        chrome.invalidate(presented_content);
+    }
+
+    // Take the HUD off; render_frame() puts it back on top if it is shown
+    if (hud_presented.width > 0) {
+        chrome.invalidate(hud_presented);
+    }
+
+    for (const auto& region : chrome.get_damage()) {
+        ui_renderer->paint(chrome, region, CHROME_BACKGROUND);
+        chrome_damage.push_back(region);
+    }
+    chrome.clear_damage();
+}
+
+void BrowserWindow::add_overview() {
+    // The widest cells, up to a thumbnail's width, that fit every tab in
+    // the content area
+    overview_cells.clear();
+    overview_caption_height = 0;
+    const PixelRect area{10, 85, std::max(0, window_width - 20), std::max(0, window_height - 95)};
+    const int count = tab_manager->get_tab_count();
+    if (count == 0 || area.width <= 0 || area.height <= 0) {
+        return;
+    }
+    int cell_width = 0;
+    int columns = 1;
+    for (int c = 1; c <= count; ++c) {
+        const int rows = (count + c - 1) / c;
+        const int row_height = (area.height - (rows - 1) * OVERVIEW_GAP) / rows;
+        const int column_width =
+            std::min(ThumbnailCache::THUMBNAIL_WIDTH, (area.width - (c - 1) * OVERVIEW_GAP) / c);
+        int caption = OVERVIEW_CAPTION_HEIGHT;
+        int width = std::min<int64_t>(column_width, int64_t{row_height - caption} * area.width / area.height);
+        if (width < OVERVIEW_MIN_CAPTIONED_WIDTH) {
+            caption = 0;
+            width = std::min<int64_t>(column_width, int64_t{row_height} * area.width / area.height);
+        }
+        if (width > cell_width) {
+            cell_width = width;
+            columns = c;
+            overview_caption_height = caption;
+        }
+    }
+    if (cell_width <= 0) {
+        return;
+    }
+
+    const int cell_height = std::max<int64_t>(1, int64_t{cell_width} * area.height / area.width);
+    const int left = area.x + (area.width - columns * cell_width - (columns - 1) * OVERVIEW_GAP) / 2;
+    for (int i = 0; i < count; ++i) {
+        auto tab = tab_manager->get_tab(i);
+        const PixelRect cell{left + (i % columns) * (cell_width + OVERVIEW_GAP),
+                             area.y + (i / columns) * (cell_height + overview_caption_height + OVERVIEW_GAP),
+                             cell_width, cell_height};
+        overview_cells.push_back(cell);
+
+        // Shown until the tab's thumbnail is drawn over it
+        const uint32_t id = CHROME_OVERVIEW + static_cast<uint32_t>(i) * CHROME_ID_STRIDE;
+        DisplayItem placeholder;
+        placeholder.kind = DisplayItem::Kind::FILL_RECT;
+        placeholder.rect = Rect(cell.x, cell.y, cell.width, cell.height);
+        placeholder.color = OVERVIEW_PLACEHOLDER;
+        chrome.set(id, placeholder);
+        if (tab->is_active) {
+            DisplayItem outline;
+            outline.kind = DisplayItem::Kind::STROKE_RECT;
+            outline.rect = Rect(cell.x - 3, cell.y - 3, cell.width + 6, cell.height + 6);
+            outline.color = OVERVIEW_ACTIVE;
+            outline.stroke_width = 2.0f;
+            chrome.set(id + 1, outline);
+        }
+        if (overview_caption_height > 0) {
+            Rect caption(cell.x, cell.y + cell.height + 2, cell.width, overview_caption_height - 2);
+            chrome.add_tab(id + 4, caption, tab->title, tab->is_active);
+        }
+    }
+}
+
+PixelRect BrowserWindow::visible_content_rect() const {
+    // The content area, once the active tab has a frame. A frame rendered
+    // for another size is scaled to fit until its re-render lands.
+    PixelRect shown{10, 85, 0, 0};
+    auto active_tab = tab_manager->get_active_tab();
+    if (active_tab && active_tab->is_resident() && !overview_visible) {
+        shown.width = std::max(0, window_width - 20);
+        shown.height = std::max(0, window_height - 95);
+    }
+    return shown;
 }
 
 void BrowserWindow::render_frame() {
+    TRACE_SCOPE("render_frame");
     if (!surface) return;
     
-    // Copy frame buffer to SDL surface
     const auto& frame_buffer = ui_renderer->get_frame_buffer();
-    
+
+    auto active_tab = tab_manager->get_active_tab();
+    const PixelRect shown = visible_content_rect();
+    const int shown_tab_id = active_tab ? active_tab->id : 0;
+    const bool scaled = shown.width > 0 && shown.height > 0 &&
+                        (active_tab->content_width != shown.width || active_tab->content_height != shown.height);
+    const bool full_content = content_damage_full || scaled || shown_tab_id != presented_tab_id ||
+                              shown.width != presented_content.width || shown.height != presented_content.height;
+
     // Lock surface
     if (SDL_MUSTLOCK(surface)) {
         SDL_LockSurface(surface);
     }
+
+    std::vector<SDL_Rect> updated;
+    auto mark_updated = [&](const PixelRect& r) {
+        updated.push_back(SDL_Rect{r.x, r.y, r.width, r.height});
+    };
     
-    // Copy pixel data from UI renderer
-    uint32_t* pixels = static_cast<uint32_t*>(surface->pixels);
-    for (size_t i = 0; i < frame_buffer.size(); i += 4) {
-        uint32_t r = frame_buffer[i];
-        uint32_t g = frame_buffer[i + 1];
-        uint32_t b = frame_buffer[i + 2];
-        uint32_t a = frame_buffer[i + 3];
-        pixels[i / 4] = SDL_MapRGBA(surface->format, r, g, b, a);
+    // Copy the repainted chrome; wherever it overlaps the content, the
+    // content goes back on top below
+    const int chrome_stride = ui_renderer->get_width();
+    const PixelRect chrome_bounds{0, 0, std::min(window_width, ui_renderer->get_width()),
+                                  std::min(window_height, ui_renderer->get_height())};
+    for (const auto& damaged : chrome_damage) {
+        const PixelRect r = intersect_rects(damaged, chrome_bounds);
+        if (r.width <= 0 || r.height <= 0) {
+            continue;
+        }
+        blit_argb(surface, reinterpret_cast<const uint8_t*>(&frame_buffer[r.y * chrome_stride + r.x]),
+                  static_cast<size_t>(chrome_stride) * 4, r.x, r.y, r.width, r.height);
+        mark_updated(r);
+
+        const PixelRect covered = intersect_rects(r, shown);
+        if (!full_content && covered.width > 0 && covered.height > 0) {
+            content_damage.push_back(PixelRect{covered.x - shown.x, covered.y - shown.y, covered.width, covered.height});
+        }
+    }
+
+    // Overview thumbnails, from the cache only: whatever a cell showed stays
+    // unless a newer thumbnail landed or the chrome under it was repainted
+    overview_presented.resize(overview_cells.size());
+    for (size_t i = 0; i < overview_cells.size(); ++i) {
+        const PixelRect& cell = overview_cells[i];
+        auto thumbnail = thumbnails->get(tab_manager->get_tab(static_cast<int>(i))->id);
+        const PixelRect fitted = intersect_rects(cell, chrome_bounds);
+        if (!thumbnail || fitted.width != cell.width || fitted.height != cell.height) {
+            overview_presented[i].reset();
+            continue;
+        }
+        const PixelBufferRef& level = thumbnail->level_for(cell.width);
+        bool stale = content_damage_full || level != overview_presented[i];
+        for (size_t d = 0; d < chrome_damage.size() && !stale; ++d) {
+            stale = rects_intersect(chrome_damage[d], cell);
+        }
+        if (!stale) {
+            continue;
+        }
+        composite_scaled_argb(surface, frame_buffer.data(), static_cast<size_t>(chrome_stride), level->data(),
+                              level->get_width(), level->get_height(), level->get_stride(), cell.x, cell.y,
+                              cell.width, cell.height, scale_columns, scale_row, convert_row);
+        mark_updated(cell);
+        overview_presented[i] = level;
     }
+    chrome_damage.clear();
     
-    // Blend rendered content from active tab if available
-    auto active_tab = tab_manager->get_active_tab();
-    if (active_tab && !active_tab->rendered_content.empty()) {
-        int content_x = 10;
-        int content_y = 85;
-        int content_width = window_width - 20;
-        int content_height = window_height - 95;
-        
-        if (content_width > 0 && content_height > 0) {
-            const auto& rendered = active_tab->rendered_content;
-            for (int y = 0; y < content_height && y * content_width * 4 + 3 < rendered.size(); ++y) {
-                for (int x = 0; x < content_width; ++x) {
-                    int src_idx = (y * content_width + x) * 4;
-                    int dst_pixel_idx = (content_y + y) * window_width + (content_x + x);
-                    
-                    if (src_idx + 3 < rendered.size() && dst_pixel_idx < window_width * window_height) {
-                        uint32_t r = rendered[src_idx];
-                        uint32_t g = rendered[src_idx + 1];
-                        uint32_t b = rendered[src_idx + 2];
-                        uint32_t a = rendered[src_idx + 3];
-                        pixels[dst_pixel_idx] = SDL_MapRGBA(surface->format, r, g, b, a);
-                    }
-                }
+    // Blit the damaged parts of the active tab's content
+    if (shown.width > 0 && shown.height > 0) {
+        const PixelBuffer& rendered = *active_tab->rendered_content;
+        const size_t stride = rendered.get_stride();
+
+        const PixelRect backdrop{chrome_bounds.x - shown.x, chrome_bounds.y - shown.y, chrome_bounds.width,
+                                 chrome_bounds.height};
+        auto blit_content = [&](const PixelRect& rect) {
+            const PixelRect r =
+                intersect_rects(intersect_rects(rect, PixelRect{0, 0, shown.width, shown.height}), backdrop);
+            if (r.width > 0 && r.height > 0) {
+                composite_argb(surface, frame_buffer.data(), static_cast<size_t>(chrome_stride),
+                               rendered.row(r.y) + r.x * 4, stride, shown.x + r.x, shown.y + r.y, r.width,
+                               r.height, convert_row);
+                mark_updated(PixelRect{shown.x + r.x, shown.y + r.y, r.width, r.height});
+            }
+        };
+
+        if (scaled) {
+            const PixelRect r = intersect_rects(shown, chrome_bounds);
+            if (r.width > 0 && r.height > 0) {
+                composite_scaled_argb(surface, frame_buffer.data(), static_cast<size_t>(chrome_stride),
+                                      rendered.data(), rendered.get_width(), rendered.get_height(), stride,
+                                      shown.x, shown.y, shown.width, shown.height, scale_columns, scale_row,
+                                      convert_row);
+                mark_updated(r);
+            }
+        } else if (full_content) {
+            blit_content(PixelRect{0, 0, shown.width, shown.height});
+        } else {
+            for (const auto& rect : content_damage) {
+                blit_content(rect);
             }
         }
     }
+    content_damage.clear();
+    content_damage_full = false;
+    presented_tab_id = shown_tab_id;
+    presented_content = shown;
+
+    hud_presented = PixelRect{0, 0, 0, 0};
+    if (hud_visible && draw_hud().width > 0) {
+        mark_updated(hud_presented);
+    }
     
     // Unlock and update
     if (SDL_MUSTLOCK(surface)) {
         SDL_UnlockSurface(surface);
     }
     
-    SDL_UpdateWindowSurface(window);
+    if (window && !updated.empty()) {
+        SDL_UpdateWindowSurfaceRects(window, updated.data(), static_cast<int>(updated.size()));
+    }
+}
+
+PixelRect BrowserWindow::draw_hud() {
+    // Stats of the frames before this one
+    char lines[3][48];
+    std::snprintf(lines[0], sizeof(lines[0]), "frame %.1f ms", frame_stats.last());
+    std::snprintf(lines[1], sizeof(lines[1]), "p99 %.1f ms", frame_stats.p99());
+    std::snprintf(lines[2], sizeof(lines[2]), "dropped %d/%d", frame_stats.dropped(), frame_stats.count());
+
+    const int line_height = GlyphCache::line_height(HUD_FONT_SIZE) + 2;
+    const int hud_height = 3 * line_height + 6;
+    if (!hud_renderer) {
+        hud_renderer = std::make_unique<UIRenderer>(HUD_WIDTH, hud_height);
+    }
+    hud_renderer->clear(HUD_BACKGROUND);
+    for (int i = 0; i < 3; ++i) {
+        hud_renderer->draw_text(lines[i], 6, 4 + i * line_height, HUD_TEXT, HUD_FONT_SIZE);
+    }
+
+    const PixelRect placed{window_width - 10 - HUD_WIDTH, 90, HUD_WIDTH, hud_height};
+    const PixelRect hud = intersect_rects(placed, PixelRect{0, 0, surface->w, surface->h});
+    if (hud.width <= 0 || hud.height <= 0) {
+        return hud;
+    }
+    const auto& pixels = hud_renderer->get_frame_buffer();
+    overlay_argb(surface, &pixels[static_cast<size_t>(hud.y - placed.y) * HUD_WIDTH + (hud.x - placed.x)],
+                 HUD_WIDTH, hud.x, hud.y, hud.width, hud.height, convert_row);
+    hud_presented = hud;
+    return hud;
 }
 
 void BrowserWindow::update_url_bar_from_input(const std::string& input) {
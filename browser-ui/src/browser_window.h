@@ -3,23 +3,52 @@
 #include <cstdint>
 #include <string>
 #include <memory>
+#include <iosfwd>
+#include <unordered_map>
 #include "tab_manager.h"
 #include "ui_renderer.h"
+#include "display_list.h"
+#include "work_pool.h"
 #include "renderer_bridge.h"
+#include "session_store.h"
+#include "thumbnail_cache.h"
+#include "trace.h"
 
 struct SDL_Window;
 struct SDL_Surface;
+union SDL_Event;
 
 class BrowserWindow {
 public:
-    BrowserWindow(int width, int height, const std::string& title);
+    // A headless window has no display: it only needs SDL's event queue
+    // and draws into an offscreen surface of the window size
+    BrowserWindow(int width, int height, const std::string& title, bool headless = false);
     ~BrowserWindow();
     
     // Main window loop
     void run();
+
+    // Drive the window from a script instead of the user, one command per
+    // line ('#' starts a comment):
+    //   navigate URL      load URL in the active tab
+    //   click X Y         left click at window coordinates
+    //   key NAME          press a key, by SDL key name ("Return", "W", ...)
+    //   resize W H        resize the window as a drag would
+    //   wait MS           keep running the loop for MS milliseconds
+    //   idle [MS]         run until no render or resize is pending (default
+    //                     timeout 10000)
+    //   frame PATH        save the window contents as a BMP
+    //   repaint N         redraw the whole window N times and print the
+    //                     frame times
+    //   hud on|off        show or hide the frame-time HUD
+    //   overview on|off   show or hide the tab overview
+    //   trace PATH        write the frame trace as Chrome trace JSON
+    // Returns false on the first command that fails.
+    bool run_script(const std::string& path);
     
     // Event handling
     void handle_events();
+    void handle_event(const SDL_Event& event);
     void handle_mouse_click(float x, float y);
     void handle_key_press(int key);
     
@@ -34,27 +63,116 @@ public:
     
     bool is_running() const { return running; }
 
+    // Memory the frames of all tabs may take; see TabManager
+    void set_tab_memory_budget(size_t bytes) { tab_manager->set_memory_budget(bytes); }
+
+    // Restore the tabs saved in path, if there are any, and keep the
+    // session saved there from now on
+    void open_session(const std::string& path);
+
 private:
     // Window and rendering
     SDL_Window* window;
-    SDL_Surface* surface;
+    SDL_Surface* surface; // owned by us when headless, by window otherwise
     int window_width, window_height;
     bool running;
+    bool headless;
+
+    // Frames are only drawn when something invalidated the window: input,
+    // a finished render or a resize. Otherwise run() sleeps in
+    // SDL_WaitEventTimeout; renderer completions wake it with an event of
+    // render_event_type.
+    bool needs_redraw;
+    uint32_t render_event_type;
     
     // Browser components
     std::unique_ptr<TabManager> tab_manager;
+    std::unique_ptr<WorkStealingPool> raster_pool; // outlives ui_renderer
     std::unique_ptr<UIRenderer> ui_renderer;
     std::unique_ptr<RendererBridge> renderer_bridge;
-    
-    // History for back/forward (simplified)
-    std::vector<std::string> history;
-    int history_index;
+    std::unique_ptr<ThumbnailCache> thumbnails;
     
     // UI State
     std::string current_url;
     bool url_bar_focused;
     
+    // Completed renders drained once per frame
+    std::vector<RenderCompletion> render_completions;
+
+    // Content pixels on the window surface are only rewritten where the
+    // active tab changed; a full blit is forced when the tab, the visible
+    // content size or the surface itself changes.
+    std::vector<PixelRect> content_damage;
+    bool content_damage_full;
+    int presented_tab_id;
+    PixelRect presented_content;
+
+    // A window drag resizes the framebuffer in place and shows the old
+    // content scaled; tabs are re-rendered at the new size once no resize
+    // has arrived for a while (resize_settle_at, in SDL ticks). The scratch
+    // buffers of the scaled blit are kept so a drag does not allocate.
+    bool resize_pending;
+    uint32_t resize_settle_at;
+    std::vector<int32_t> scale_columns;
+    std::vector<uint32_t> scale_row;
+    std::vector<uint32_t> convert_row;
+
+    // Retained chrome; update_display() repaints only what changed in it
+    // and leaves the repainted window regions in chrome_damage
+    DisplayList chrome;
+    std::vector<PixelRect> chrome_damage;
+
+    // Frame-time HUD (F10), drawn by its own small UIRenderer over the
+    // finished frame. What it covered is repainted on the next frame.
+    // F12 or SIGUSR1 writes the frame trace.
+    FrameStats frame_stats;
+    std::unique_ptr<UIRenderer> hud_renderer;
+    bool hud_visible;
+    PixelRect hud_presented;
+
+    // Tab overview (F9): a grid of every tab's thumbnail over the content
+    // area. The cells' placeholders and captions are chrome items; the
+    // thumbnails are composited on top, and only redrawn where a thumbnail
+    // changed or the chrome under it was repainted. overview_presented
+    // holds the level each cell shows.
+    bool overview_visible;
+    std::vector<PixelRect> overview_cells; // thumbnail rects, in tab order
+    int overview_caption_height;
+    std::vector<PixelBufferRef> overview_presented;
+
+    // Session file. Restored tabs show their saved frame until they are
+    // rendered again, which for background tabs waits until they are first
+    // shown; saved_frames holds the frames no tab has loaded yet. At most
+    // every SESSION_SYNC_MS the store is sent whatever changed since the
+    // state recorded in session_tabs and session_active_id.
+    struct SessionTabState {
+        std::string url;
+        std::string title;
+        std::vector<std::string> history;
+        int history_index;
+        uint32_t content_version;
+    };
+    std::unique_ptr<SessionStore> session;
+    std::unordered_map<int, SavedFrame> saved_frames;
+    std::unordered_map<int, SessionTabState> session_tabs;
+    int session_active_id;
+    uint32_t session_sync_at;
+
     // Helper methods
+    void step(int max_wait_ms);
+    bool busy() const;
+    void acquire_surface();
+    bool run_command(const std::string& command, std::istringstream& args);
     void render_frame();
+    PixelRect draw_hud();
+    void add_overview();
+    PixelRect visible_content_rect() const;
+    void process_render_completions();
+    void activate_tab(int index);
+    void load_page(Tab& tab);
+    void step_history(int delta);
+    bool load_saved_frame(Tab& tab);
+    void sync_session();
+    void rerender_after_resize();
     void update_url_bar_from_input(const std::string& input);
 };
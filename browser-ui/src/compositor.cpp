@@ -0,0 +1,267 @@
+#include "compositor.h"
+#include <algorithm>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define SQU1D_UI_X86 1
+#endif
+
+namespace {
+
+// a * b / 255, rounded; exact for a, b in [0, 255]
+inline uint32_t mul255(uint32_t a, uint32_t b) {
+    const uint32_t t = a * b + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+template <BlendMode M>
+inline uint32_t blend_pixel(uint32_t s, uint32_t d) {
+    const uint32_t sa = s >> 24;
+    const uint32_t da = d >> 24;
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        const uint32_t sc = (s >> shift) & 0xff;
+        const uint32_t dc = (d >> shift) & 0xff;
+        uint32_t v = 0;
+        if constexpr (M == BlendMode::SOURCE_OVER) {
+            v = sc + mul255(dc, 255 - sa);
+        } else if constexpr (M == BlendMode::MULTIPLY) {
+            v = mul255(sc, dc) + mul255(sc, 255 - da) + mul255(dc, 255 - sa);
+        } else if constexpr (M == BlendMode::SCREEN) {
+            v = sc + dc - mul255(sc, dc);
+        } else {
+            v = sc + dc;
+        }
+        result |= std::min(v, 255u) << shift;
+    }
+    return result;
+}
+
+template <BlendMode M, bool SOLID>
+void blend_generic(uint32_t* dst, const uint32_t* src, size_t count, uint32_t solid) {
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = blend_pixel<M>(SOLID ? solid : src[i], dst[i]);
+    }
+}
+
+#ifdef SQU1D_UI_X86
+// The SIMD kernels widen two pixels per 128-bit lane to 16-bit channels,
+// apply the same per-channel formula as blend_pixel and pack back with
+// unsigned saturation, so results match the scalar path bit for bit.
+
+__attribute__((target("sse2")))
+inline __m128i mul255_epi16(__m128i a, __m128i b) {
+    const __m128i t = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("sse2")))
+inline __m128i alpha_epi16(__m128i x) {
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+template <BlendMode M>
+__attribute__((target("sse2")))
+inline __m128i blend_wide_sse2(__m128i s, __m128i d) {
+    const __m128i c255 = _mm_set1_epi16(255);
+    if constexpr (M == BlendMode::SOURCE_OVER) {
+        return _mm_add_epi16(s, mul255_epi16(d, _mm_sub_epi16(c255, alpha_epi16(s))));
+    } else if constexpr (M == BlendMode::MULTIPLY) {
+        return _mm_add_epi16(_mm_add_epi16(mul255_epi16(s, d), mul255_epi16(s, _mm_sub_epi16(c255, alpha_epi16(d)))),
+                             mul255_epi16(d, _mm_sub_epi16(c255, alpha_epi16(s))));
+    } else if constexpr (M == BlendMode::SCREEN) {
+        return _mm_sub_epi16(_mm_add_epi16(s, d), mul255_epi16(s, d));
+    } else {
+        return _mm_add_epi16(s, d);
+    }
+}
+
+template <BlendMode M, bool SOLID>
+__attribute__((target("sse2")))
+void blend_sse2(uint32_t* dst, const uint32_t* src, size_t count, uint32_t solid) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha_mask = _mm_set1_epi32(static_cast<int>(0xff000000u));
+    const __m128i fixed = _mm_set1_epi32(static_cast<int>(solid));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i s = SOLID ? fixed : _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        if constexpr (M == BlendMode::SOURCE_OVER && !SOLID) {
+            // Opaque and fully transparent runs are common in page content
+            const __m128i a = _mm_and_si128(s, alpha_mask);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(a, alpha_mask)) == 0xffff) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), s);
+                continue;
+            }
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(s, zero)) == 0xffff) {
+                continue;
+            }
+        }
+        const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        const __m128i lo = blend_wide_sse2<M>(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+        const __m128i hi = blend_wide_sse2<M>(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+    }
+    for (; i < count; ++i) {
+        dst[i] = blend_pixel<M>(SOLID ? solid : src[i], dst[i]);
+    }
+}
+
+__attribute__((target("avx2")))
+inline __m256i mul255_epi16(__m256i a, __m256i b) {
+    const __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(a, b), _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("avx2")))
+inline __m256i alpha_epi16(__m256i x) {
+    return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+template <BlendMode M>
+__attribute__((target("avx2")))
+inline __m256i blend_wide_avx2(__m256i s, __m256i d) {
+    const __m256i c255 = _mm256_set1_epi16(255);
+    if constexpr (M == BlendMode::SOURCE_OVER) {
+        return _mm256_add_epi16(s, mul255_epi16(d, _mm256_sub_epi16(c255, alpha_epi16(s))));
+    } else if constexpr (M == BlendMode::MULTIPLY) {
+        return _mm256_add_epi16(
+            _mm256_add_epi16(mul255_epi16(s, d), mul255_epi16(s, _mm256_sub_epi16(c255, alpha_epi16(d)))),
+            mul255_epi16(d, _mm256_sub_epi16(c255, alpha_epi16(s))));
+    } else if constexpr (M == BlendMode::SCREEN) {
+        return _mm256_sub_epi16(_mm256_add_epi16(s, d), mul255_epi16(s, d));
+    } else {
+        return _mm256_add_epi16(s, d);
+    }
+}
+
+template <BlendMode M, bool SOLID>
+__attribute__((target("avx2")))
+void blend_avx2(uint32_t* dst, const uint32_t* src, size_t count, uint32_t solid) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alpha_mask = _mm256_set1_epi32(static_cast<int>(0xff000000u));
+    const __m256i fixed = _mm256_set1_epi32(static_cast<int>(solid));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i s = SOLID ? fixed : _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        if constexpr (M == BlendMode::SOURCE_OVER && !SOLID) {
+            const __m256i a = _mm256_and_si256(s, alpha_mask);
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(a, alpha_mask)) == -1) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), s);
+                continue;
+            }
+            if (_mm256_testz_si256(s, s)) {
+                continue;
+            }
+        }
+        const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        const __m256i lo = blend_wide_avx2<M>(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero));
+        const __m256i hi = blend_wide_avx2<M>(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+    for (; i < count; ++i) {
+        dst[i] = blend_pixel<M>(SOLID ? solid : src[i], dst[i]);
+    }
+}
+#endif
+
+using GatherKernel = void (*)(uint32_t* dst, const uint32_t* src, const int32_t* columns, size_t count);
+
+void gather_generic(uint32_t* dst, const uint32_t* src, const int32_t* columns, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = src[columns[i]];
+    }
+}
+
+#ifdef SQU1D_UI_X86
+__attribute__((target("avx2")))
+void gather_avx2(uint32_t* dst, const uint32_t* src, const int32_t* columns, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(columns + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                            _mm256_i32gather_epi32(reinterpret_cast<const int*>(src), index, 4));
+    }
+    for (; i < count; ++i) {
+        dst[i] = src[columns[i]];
+    }
+}
+#endif
+
+GatherKernel pick_gather_kernel() {
+#ifdef SQU1D_UI_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return gather_avx2;
+#endif
+    return gather_generic;
+}
+
+const GatherKernel gather_kernel = pick_gather_kernel();
+
+// One kernel per mode after SOURCE, which is a plain copy or fill
+using BlendKernel = void (*)(uint32_t* dst, const uint32_t* src, size_t count, uint32_t solid);
+
+struct BlendKernels {
+    BlendKernel span[4];
+    BlendKernel solid[4];
+};
+
+BlendKernels pick_blend_kernels() {
+#ifdef SQU1D_UI_X86
+    __builtin_cpu_init(); // may run before other static constructors
+    if (__builtin_cpu_supports("avx2")) {
+        return BlendKernels{
+            {blend_avx2<BlendMode::SOURCE_OVER, false>, blend_avx2<BlendMode::MULTIPLY, false>,
+             blend_avx2<BlendMode::SCREEN, false>, blend_avx2<BlendMode::PLUS, false>},
+            {blend_avx2<BlendMode::SOURCE_OVER, true>, blend_avx2<BlendMode::MULTIPLY, true>,
+             blend_avx2<BlendMode::SCREEN, true>, blend_avx2<BlendMode::PLUS, true>},
+        };
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return BlendKernels{
+            {blend_sse2<BlendMode::SOURCE_OVER, false>, blend_sse2<BlendMode::MULTIPLY, false>,
+             blend_sse2<BlendMode::SCREEN, false>, blend_sse2<BlendMode::PLUS, false>},
+            {blend_sse2<BlendMode::SOURCE_OVER, true>, blend_sse2<BlendMode::MULTIPLY, true>,
+             blend_sse2<BlendMode::SCREEN, true>, blend_sse2<BlendMode::PLUS, true>},
+        };
+    }
+#endif
+    return BlendKernels{
+        {blend_generic<BlendMode::SOURCE_OVER, false>, blend_generic<BlendMode::MULTIPLY, false>,
+         blend_generic<BlendMode::SCREEN, false>, blend_generic<BlendMode::PLUS, false>},
+        {blend_generic<BlendMode::SOURCE_OVER, true>, blend_generic<BlendMode::MULTIPLY, true>,
+         blend_generic<BlendMode::SCREEN, true>, blend_generic<BlendMode::PLUS, true>},
+    };
+}
+
+const BlendKernels kernels = pick_blend_kernels();
+
+} // namespace
+
+uint32_t premultiply(const Color& color) {
+    const uint32_t a = color.a;
+    return (a << 24) | (mul255(color.r, a) << 16) | (mul255(color.g, a) << 8) | mul255(color.b, a);
+}
+
+void blend_span(uint32_t* dst, const uint32_t* src, size_t count, BlendMode mode) {
+    if (mode == BlendMode::SOURCE) {
+        std::memmove(dst, src, count * sizeof(uint32_t));
+        return;
+    }
+    kernels.span[static_cast<int>(mode) - 1](dst, src, count, 0);
+}
+
+void blend_span_solid(uint32_t* dst, size_t count, uint32_t src, BlendMode mode) {
+    if (mode == BlendMode::SOURCE) {
+        std::fill_n(dst, count, src);
+        return;
+    }
+    if (mode == BlendMode::SOURCE_OVER && (src >> 24) == 0) {
+        return;
+    }
+    kernels.solid[static_cast<int>(mode) - 1](dst, nullptr, count, src);
+}
+
+void gather_span(uint32_t* dst, const uint32_t* src, const int32_t* columns, size_t count) {
+    gather_kernel(dst, src, columns, count);
+}
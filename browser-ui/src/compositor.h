@@ -0,0 +1,51 @@
+#pragma once
+
+#include "ui_types.h"
+#include <cstddef>
+#include <cstdint>
+
+// Span compositing for premultiplied ARGB8888 pixels. Every mode combines a
+// source into the destination in place; the formulas are the usual
+// premultiplied ones, with each product rounded to 8 bits:
+//   SOURCE       d = s
+//   SOURCE_OVER  d = s + d * (1 - sa)
+//   MULTIPLY     d = s * d + s * (1 - da) + d * (1 - sa)
+//   SCREEN       d = s + d - s * d
+//   PLUS         d = min(1, s + d)
+// The kernels use the widest of AVX2 / SSE2 the CPU supports, picked once at
+// startup, and give the same result as the scalar fallback.
+enum class BlendMode {
+    SOURCE,
+    SOURCE_OVER,
+    MULTIPLY,
+    SCREEN,
+    PLUS,
+};
+
+// Straight-alpha color to a premultiplied ARGB8888 pixel
+uint32_t premultiply(const Color& color);
+
+// Every channel of a premultiplied pixel times factor / 255, rounded like
+// the span kernels; two channels per 32-bit multiply
+inline uint32_t scale_pixel(uint32_t pixel, uint32_t factor) {
+    uint32_t rb = (pixel & 0x00ff00ff) * factor + 0x00800080;
+    rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+    uint32_t ag = ((pixel >> 8) & 0x00ff00ff) * factor + 0x00800080;
+    ag = (ag + ((ag >> 8) & 0x00ff00ff)) & 0xff00ff00;
+    return rb | ag;
+}
+
+// SOURCE_OVER for a single pixel, for callers with only a few. Both pixels
+// must be valid premultiplied (no channel above alpha).
+inline uint32_t blend_pixel_over(uint32_t src, uint32_t dst) {
+    return src + scale_pixel(dst, 255 - (src >> 24));
+}
+
+// Blend count source pixels into dst
+void blend_span(uint32_t* dst, const uint32_t* src, size_t count, BlendMode mode);
+
+// Blend one source pixel into each of count dst pixels
+void blend_span_solid(uint32_t* dst, size_t count, uint32_t src, BlendMode mode);
+
+// Nearest-neighbour resampling of one row: dst[i] = src[columns[i]]
+void gather_span(uint32_t* dst, const uint32_t* src, const int32_t* columns, size_t count);
@@ -0,0 +1,197 @@
+#include "display_list.h"
+#include "glyph_cache.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Damage rects beyond this are folded into their bounding box
+constexpr size_t MAX_DAMAGE_RECTS = 16;
+
+bool empty_rect(const PixelRect& r) {
+    return r.width <= 0 || r.height <= 0;
+}
+
+// Top of a line of text vertically centred in rect
+float centered_text_y(const Rect& rect, float font_size) {
+    return rect.y + std::floor((rect.height - GlyphCache::line_height(font_size)) / 2);
+}
+
+} // namespace
+
+bool rects_intersect(const PixelRect& a, const PixelRect& b) {
+    return !empty_rect(intersect_rects(a, b));
+}
+
+PixelRect intersect_rects(const PixelRect& a, const PixelRect& b) {
+    const int x0 = std::max(a.x, b.x);
+    const int y0 = std::max(a.y, b.y);
+    const int x1 = std::min(a.x + a.width, b.x + b.width);
+    const int y1 = std::min(a.y + a.height, b.y + b.height);
+    return PixelRect{x0, y0, std::max(0, x1 - x0), std::max(0, y1 - y0)};
+}
+
+PixelRect union_rects(const PixelRect& a, const PixelRect& b) {
+    if (empty_rect(a)) return b;
+    if (empty_rect(b)) return a;
+    const int x0 = std::min(a.x, b.x);
+    const int y0 = std::min(a.y, b.y);
+    const int x1 = std::max(a.x + a.width, b.x + b.width);
+    const int y1 = std::max(a.y + a.height, b.y + b.height);
+    return PixelRect{x0, y0, x1 - x0, y1 - y0};
+}
+
+PixelRect DisplayItem::bounds() const {
+    if (kind == Kind::TEXT) {
+        const PixelRect extent{static_cast<int>(rect.x), static_cast<int>(rect.y),
+                               GlyphCache::measure(text, font_size), GlyphCache::line_height(font_size)};
+        return has_clip() ? intersect_rects(extent, clip_box()) : extent;
+    }
+    return clip_box();
+}
+
+PixelRect DisplayItem::clip_box() const {
+    const int x0 = static_cast<int>(std::floor(rect.x));
+    const int y0 = static_cast<int>(std::floor(rect.y));
+    const int x1 = static_cast<int>(std::ceil(rect.x + rect.width));
+    const int y1 = static_cast<int>(std::ceil(rect.y + rect.height));
+    return PixelRect{x0, y0, x1 - x0, y1 - y0};
+}
+
+bool DisplayItem::operator==(const DisplayItem& other) const {
+    return kind == other.kind && rect.x == other.rect.x && rect.y == other.rect.y &&
+           rect.width == other.rect.width && rect.height == other.rect.height &&
+           color.r == other.color.r && color.g == other.color.g && color.b == other.color.b &&
+           color.a == other.color.a && radius == other.radius && stroke_width == other.stroke_width &&
+           text == other.text && font_size == other.font_size;
+}
+
+void DisplayList::begin() {
+    seen.clear();
+}
+
+void DisplayList::set(uint32_t id, const DisplayItem& item) {
+    seen.insert(id);
+    auto it = items.find(id);
+    if (it == items.end()) {
+        invalidate(item.bounds());
+        items.emplace(id, item);
+        return;
+    }
+    if (it->second != item) {
+        invalidate(it->second.bounds());
+        invalidate(item.bounds());
+        it->second = item;
+    }
+}
+
+void DisplayList::end() {
+    for (auto it = items.begin(); it != items.end();) {
+        if (seen.count(it->first)) {
+            ++it;
+            continue;
+        }
+        invalidate(it->second.bounds());
+        it = items.erase(it);
+    }
+}
+
+void DisplayList::invalidate(const PixelRect& rect) {
+    if (empty_rect(rect)) {
+        return;
+    }
+
+    // Merge with anything it overlaps, until no more merges happen
+    PixelRect merged = rect;
+    for (size_t i = 0; i < damage.size();) {
+        if (rects_intersect(damage[i], merged)) {
+            merged = union_rects(damage[i], merged);
+            damage.erase(damage.begin() + i);
+            i = 0;
+        } else {
+            ++i;
+        }
+    }
+    damage.push_back(merged);
+
+    if (damage.size() > MAX_DAMAGE_RECTS) {
+        PixelRect all = damage[0];
+        for (const auto& r : damage) {
+            all = union_rects(all, r);
+        }
+        damage.assign(1, all);
+    }
+}
+
+void DisplayList::add_fill(uint32_t id, const Rect& rect, const Color& color) {
+    DisplayItem item;
+    item.kind = DisplayItem::Kind::FILL_RECT;
+    item.rect = rect;
+    item.color = color;
+    set(id, item);
+}
+
+void DisplayList::add_stroke(uint32_t id, const Rect& rect, const Color& color, float stroke_width) {
+    DisplayItem item;
+    item.kind = DisplayItem::Kind::STROKE_RECT;
+    item.rect = rect;
+    item.color = color;
+    item.stroke_width = stroke_width;
+    set(id, item);
+}
+
+void DisplayList::add_rounded(uint32_t id, const Rect& rect, const Color& color, float radius, float stroke_width) {
+    DisplayItem item;
+    item.kind = DisplayItem::Kind::ROUNDED_RECT;
+    item.rect = rect;
+    item.color = color;
+    item.radius = radius;
+    item.stroke_width = stroke_width;
+    set(id, item);
+}
+
+void DisplayList::add_text(uint32_t id, const std::string& text, const Rect& box, float x, float y, const Color& color,
+                           float font_size) {
+    DisplayItem item;
+    item.kind = DisplayItem::Kind::TEXT;
+    item.rect = Rect(x, y, box.width > 0 ? box.x + box.width - x : 0, box.height > 0 ? box.y + box.height - y : 0);
+    item.color = color;
+    item.text = text;
+    item.font_size = font_size;
+    set(id, item);
+}
+
+void DisplayList::add_toolbar(uint32_t id, int width, int height) {
+    Rect toolbar_rect(0, 0, width, height);
+    add_fill(id, toolbar_rect, Theme::TOOLBAR_BG);
+    add_stroke(id + 1, toolbar_rect, Theme::SEPARATOR, 1.0f);
+}
+
+void DisplayList::add_tab(uint32_t id, const Rect& rect, const std::string& title, bool is_active) {
+    // Draw tab background
+    Color bg = is_active ? Theme::TAB_BG_ACTIVE : Theme::TAB_BG_INACTIVE;
+    add_fill(id, rect, bg);
+
+    // Draw tab border with rounded corners
+    add_rounded(id + 1, rect, Theme::SEPARATOR, 4.0f, 1.0f);
+
+    // Draw tab text
+    add_text(id + 2, title, rect, rect.x + 10, centered_text_y(rect, 11.0f), Theme::TAB_TEXT, 11.0f);
+}
+
+void DisplayList::add_url_bar(uint32_t id, const Rect& rect, const std::string& url, bool focused) {
+    add_fill(id, rect, Theme::URLBAR_BG);
+
+    Color border = focused ? Color(100, 150, 255) : Theme::URLBAR_BORDER;
+    add_rounded(id + 1, rect, border, 6.0f, 1.0f);
+
+    add_text(id + 2, url, rect, rect.x + 8, centered_text_y(rect, 12.0f), Theme::TEXT_PRIMARY, 12.0f);
+}
+
+void DisplayList::add_button(uint32_t id, const Rect& rect, const std::string& label, bool hovered) {
+    Color bg = hovered ? Theme::BUTTON_HOVER : Theme::BUTTON_BG;
+    add_fill(id, rect, bg);
+    add_rounded(id + 1, rect, Theme::SEPARATOR, 4.0f, 1.0f);
+
+    add_text(id + 2, label, rect, rect.x + 5, centered_text_y(rect, 11.0f), Theme::TEXT_PRIMARY, 11.0f);
+}
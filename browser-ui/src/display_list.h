@@ -0,0 +1,73 @@
+#pragma once
+
+#include "ui_types.h"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// One retained drawing command of the browser chrome
+struct DisplayItem {
+    enum class Kind {
+        FILL_RECT,
+        STROKE_RECT,
+        ROUNDED_RECT,
+        TEXT,
+    };
+
+    Kind kind = Kind::FILL_RECT;
+    Rect rect;          // for TEXT the origin, plus a clip box if width and height are set
+    Color color;
+    float radius = 0.0f;
+    float stroke_width = 1.0f;
+    std::string text;
+    float font_size = 12.0f;
+
+    // Pixels the item may touch when painted
+    PixelRect bounds() const;
+    bool has_clip() const { return rect.width > 0 && rect.height > 0; }
+    PixelRect clip_box() const;
+    bool operator==(const DisplayItem& other) const;
+    bool operator!=(const DisplayItem& other) const { return !(*this == other); }
+};
+
+// Retained-mode description of the chrome. Every frame the window re-states
+// its items between begin() and end(); each item keeps a stable id, and only
+// items that appear, disappear or change contribute their old and new bounds
+// to damage(). Items paint in id order.
+class DisplayList {
+public:
+    void begin();
+    void set(uint32_t id, const DisplayItem& item);
+    void end(); // drops items not set since begin()
+
+    // Force a region to be repainted, e.g. after the target was recreated
+    void invalidate(const PixelRect& rect);
+
+    const std::map<uint32_t, DisplayItem>& get_items() const { return items; }
+    const std::vector<PixelRect>& get_damage() const { return damage; }
+    void clear_damage() { damage.clear(); }
+
+    // High-level UI elements (Falkon macOS inspired); each uses ids id..id+3
+    void add_toolbar(uint32_t id, int width, int height);
+    void add_tab(uint32_t id, const Rect& rect, const std::string& title, bool is_active);
+    void add_url_bar(uint32_t id, const Rect& rect, const std::string& url, bool focused);
+    void add_button(uint32_t id, const Rect& rect, const std::string& label, bool hovered = false);
+
+private:
+    std::map<uint32_t, DisplayItem> items;
+    std::unordered_set<uint32_t> seen; // ids set since begin()
+    std::vector<PixelRect> damage;
+
+    void add_fill(uint32_t id, const Rect& rect, const Color& color);
+    void add_stroke(uint32_t id, const Rect& rect, const Color& color, float stroke_width);
+    void add_rounded(uint32_t id, const Rect& rect, const Color& color, float radius, float stroke_width);
+    void add_text(uint32_t id, const std::string& text, const Rect& box, float x, float y, const Color& color,
+                  float font_size);
+};
+
+// Rectangle helpers shared by the chrome painter and the present step
+bool rects_intersect(const PixelRect& a, const PixelRect& b);
+PixelRect intersect_rects(const PixelRect& a, const PixelRect& b);
+PixelRect union_rects(const PixelRect& a, const PixelRect& b);
@@ -0,0 +1,121 @@
+#include "glyph_cache.h"
+#include "../../shared/bitmap_font.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace {
+
+constexpr int GLYPH_WIDTH = 3;
+constexpr int GLYPH_HEIGHT = 5;
+constexpr int GLYPH_COUNT = 95; // ASCII 32-126
+constexpr int MAX_SCALE = 16;
+
+// Runs beyond this are dropped wholesale; titles and URLs repeat far less
+constexpr size_t MAX_CACHED_RUNS = 1024;
+
+} // namespace
+
+int GlyphCache::scale_for(float font_size) {
+    return std::clamp(static_cast<int>(std::lround(font_size * 0.7f / GLYPH_HEIGHT)), 1, MAX_SCALE);
+}
+
+int GlyphCache::measure(const std::string& text, float font_size) {
+    // 3 pixels per glyph plus 1 pixel spacing, all scaled
+    const int scale = scale_for(font_size);
+    return text.empty() ? 0 : static_cast<int>(text.size()) * (GLYPH_WIDTH + 1) * scale - scale;
+}
+
+int GlyphCache::line_height(float font_size) {
+    return GLYPH_HEIGHT * scale_for(font_size);
+}
+
+std::shared_ptr<const TextRun> GlyphCache::get_run(const std::string& text, float font_size) {
+    const int scale = scale_for(font_size);
+    std::string key(1, static_cast<char>(scale));
+    key += text;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = runs.find(key);
+    if (it != runs.end()) {
+        return it->second;
+    }
+
+    if (runs.size() >= MAX_CACHED_RUNS) {
+        runs.clear(); // callers keep their runs alive through the shared_ptr
+    }
+    auto run = build_run(text, atlas_for(scale));
+    runs.emplace(std::move(key), run);
+    return run;
+}
+
+const GlyphCache::Atlas& GlyphCache::atlas_for(int scale) {
+    for (const auto& atlas : atlases) {
+        if (atlas->scale == scale) {
+            return *atlas;
+        }
+    }
+
+    auto atlas = std::make_unique<Atlas>();
+    atlas->scale = scale;
+    atlas->cell_width = GLYPH_WIDTH * scale;
+    atlas->cell_height = GLYPH_HEIGHT * scale;
+    const int atlas_width = atlas->cell_width * GLYPH_COUNT;
+    atlas->coverage.assign(static_cast<size_t>(atlas_width) * atlas->cell_height, 0);
+
+    for (int glyph = 0; glyph < GLYPH_COUNT; ++glyph) {
+        for (int row = 0; row < GLYPH_HEIGHT; ++row) {
+            const uint8_t bits = BITMAP_FONT_DATA[glyph * GLYPH_HEIGHT + row];
+            for (int col = 0; col < GLYPH_WIDTH; ++col) {
+                if (!(bits & (1 << (2 - col)))) {
+                    continue;
+                }
+                for (int sy = 0; sy < scale; ++sy) {
+                    uint8_t* dst = &atlas->coverage[static_cast<size_t>(row * scale + sy) * atlas_width +
+                                                    glyph * atlas->cell_width + col * scale];
+                    std::fill_n(dst, scale, uint8_t{255});
+                }
+            }
+        }
+    }
+
+    atlases.push_back(std::move(atlas));
+    return *atlases.back();
+}
+
+std::shared_ptr<const TextRun> GlyphCache::build_run(const std::string& text, const Atlas& atlas) const {
+    auto run = std::make_shared<TextRun>();
+    const int scale = atlas.scale;
+    const int atlas_width = atlas.cell_width * GLYPH_COUNT;
+    run->height = atlas.cell_height;
+
+    int pen = 0;
+    for (char c : text) {
+        if (pen > INT16_MAX - atlas.cell_width) {
+            break; // far past any window edge
+        }
+        const int glyph = static_cast<unsigned char>(c) - 32;
+        if (glyph >= 0 && glyph < GLYPH_COUNT) {
+            for (int y = 0; y < atlas.cell_height; ++y) {
+                const uint8_t* row = &atlas.coverage[static_cast<size_t>(y) * atlas_width + glyph * atlas.cell_width];
+                for (int x = 0; x < atlas.cell_width;) {
+                    if (!row[x]) {
+                        ++x;
+                        continue;
+                    }
+                    int end = x;
+                    while (end < atlas.cell_width && row[end]) {
+                        ++end;
+                    }
+                    run->spans.push_back(TextRun::Span{static_cast<int16_t>(pen + x), static_cast<int16_t>(y),
+                                                       static_cast<uint16_t>(end - x)});
+                    x = end;
+                }
+            }
+        }
+        pen += (GLYPH_WIDTH + 1) * scale;
+    }
+
+    run->width = text.empty() ? 0 : pen - scale;
+    return run;
+}
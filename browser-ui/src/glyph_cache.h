@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A string pre-rasterized at one font size: the horizontal runs of covered
+// pixels, relative to the top-left of the text. Drawing it is one span fill
+// per run.
+struct TextRun {
+    struct Span {
+        int16_t x;
+        int16_t y;
+        uint16_t length;
+    };
+
+    int width = 0;
+    int height = 0;
+    std::vector<Span> spans;
+};
+
+// Glyph atlas and text run cache for the 3x5 bitmap font (shared/bitmap_font.h).
+// Glyphs are scaled by whole pixels to approximate font_size; each scale
+// gets an atlas of pre-scaled coverage masks, built on first use, and
+// repeated strings (tab titles, the URL) are kept as ready-made runs.
+// Safe to use from several threads at once.
+class GlyphCache {
+public:
+    // Pixel scale of the 3x5 glyphs for a font size: their 5 rows stand in
+    // for the cap height, roughly 0.7 em
+    static int scale_for(float font_size);
+    static int measure(const std::string& text, float font_size);
+    static int line_height(float font_size);
+
+    std::shared_ptr<const TextRun> get_run(const std::string& text, float font_size);
+
+private:
+    // Coverage masks of all 95 glyphs side by side, cell_width apart
+    struct Atlas {
+        int scale;
+        int cell_width;
+        int cell_height;
+        std::vector<uint8_t> coverage;
+    };
+
+    const Atlas& atlas_for(int scale);
+    std::shared_ptr<const TextRun> build_run(const std::string& text, const Atlas& atlas) const;
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Atlas>> atlases;
+    std::unordered_map<std::string, std::shared_ptr<const TextRun>> runs;
+};
@@ -1,18 +1,72 @@
 #include "browser_window.h"
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 
 int main(int argc, char* argv[]) {
+    // --headless           draw offscreen; no display server needed
+    // --script FILE        drive the window from FILE, then exit
+    // --size WxH           window size (default 1200x800)
+    // --tab-memory MB      memory for tab frames before background tabs are
+    //                      compressed, then dropped (default 512)
+    // --session FILE       restore the tabs saved in FILE and keep saving
+    //                      the session there
+    bool headless = false;
+    std::string script;
+    int width = 1200;
+    int height = 800;
+    long tab_memory_mb = -1;
+    std::string session;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (std::strcmp(argv[i], "--script") == 0 && i + 1 < argc) {
+            script = argv[++i];
+        } else if (std::strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            if (std::sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+                std::cerr << "Bad window size: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--tab-memory") == 0 && i + 1 < argc) {
+            if (std::sscanf(argv[++i], "%ld", &tab_memory_mb) != 1 || tab_memory_mb < 0) {
+                std::cerr << "Bad tab memory: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--session") == 0 && i + 1 < argc) {
+            session = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--headless] [--script FILE] [--size WxH] [--tab-memory MB] [--session FILE]"
+                      << std::endl;
+            return 1;
+        }
+    }
+    if (headless && script.empty()) {
+        std::cerr << "--headless needs a --script to run" << std::endl;
+        return 1;
+    }
+
     std::cout << "Starting SQU1D Browser..." << std::endl;
-    
-    BrowserWindow browser(1200, 800, "SQU1D Browser - Falkon macOS Theme");
-    
+
+    BrowserWindow browser(width, height, "SQU1D Browser - Falkon macOS Theme", headless);
+
     if (!browser.is_running()) {
         std::cerr << "Failed to initialize browser window" << std::endl;
         return 1;
     }
-    
+    if (tab_memory_mb >= 0) {
+        browser.set_tab_memory_budget(static_cast<size_t>(tab_memory_mb) << 20);
+    }
+    if (!session.empty()) {
+        browser.open_session(session);
+    }
+
+    if (!script.empty()) {
+        return browser.run_script(script) ? 0 : 1;
+    }
+
     browser.run();
-    
+
     std::cout << "Browser closed" << std::endl;
     return 0;
 }
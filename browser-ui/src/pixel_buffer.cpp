@@ -0,0 +1,116 @@
+#include "pixel_buffer.h"
+#include <algorithm>
+#include <sys/mman.h>
+
+PixelBuffer::PixelBuffer(uint8_t* pixels, int width, int height, size_t stride, PixelFormat format,
+                         std::function<void()> release)
+    : pixels(pixels), width(width), height(height), stride(stride), format(format), release(std::move(release)) {}
+
+PixelBuffer::~PixelBuffer() {
+    if (release) {
+        release();
+    }
+}
+
+std::shared_ptr<PixelBuffer> PixelBuffer::allocate(int width, int height, PixelFormat format) {
+    if (width <= 0 || height <= 0) {
+        return nullptr;
+    }
+    // Pages of their own rather than the heap, so a frame's memory goes
+    // straight back to the system when the frame does
+    const size_t stride = static_cast<size_t>(width) * 4;
+    const size_t bytes = stride * height;
+    void* mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) {
+        return nullptr;
+    }
+    return adopt(static_cast<uint8_t*>(mapped), width, height, stride, format,
+                 [mapped, bytes] { munmap(mapped, bytes); });
+}
+
+std::shared_ptr<PixelBuffer> PixelBuffer::adopt(uint8_t* pixels, int width, int height, size_t stride,
+                                                PixelFormat format, std::function<void()> release) {
+    return std::shared_ptr<PixelBuffer>(new PixelBuffer(pixels, width, height, stride, format, std::move(release)));
+}
+
+PixelBufferPool::PixelBufferPool(size_t max_free) : state(std::make_shared<State>()) {
+    state->max_free = max_free;
+}
+
+std::shared_ptr<PixelBuffer> PixelBufferPool::take(int width, int height, PixelFormat format,
+                                                   uint64_t preferred_tag, bool* got_preferred) {
+    std::shared_ptr<PixelBuffer> buffer;
+    bool preferred = false;
+    std::vector<FreeBuffer> stale;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        auto& free = state->free;
+        // Buffers of another size are of no more use
+        auto fits = std::partition(free.begin(), free.end(), [&](const FreeBuffer& f) {
+            return f.buffer->get_width() == width && f.buffer->get_height() == height &&
+                   f.buffer->get_format() == format;
+        });
+        stale.assign(std::make_move_iterator(fits), std::make_move_iterator(free.end()));
+        free.erase(fits, free.end());
+        if (!free.empty()) {
+            auto pick = std::find_if(free.begin(), free.end(),
+                                     [preferred_tag](const FreeBuffer& f) { return f.tag == preferred_tag; });
+            preferred = preferred_tag != 0 && pick != free.end();
+            if (pick == free.end()) {
+                pick = free.begin();
+            }
+            buffer = std::move(pick->buffer);
+            free.erase(pick);
+        }
+    }
+    if (got_preferred) {
+        *got_preferred = preferred;
+    }
+    return buffer ? buffer : PixelBuffer::allocate(width, height, format);
+}
+
+PixelBufferRef PixelBufferPool::share(std::shared_ptr<PixelBuffer> buffer, uint64_t* tag) {
+    if (!buffer) {
+        return nullptr;
+    }
+    const PixelBuffer* frame = buffer.get();
+    std::weak_ptr<State> pool = state;
+    uint64_t generation, share_tag;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        generation = state->generation;
+        share_tag = ++state->last_tag;
+    }
+    if (tag) {
+        *tag = share_tag;
+    }
+    // The deleter runs after the last reference is dropped, so taking the
+    // buffer back under the pool's mutex orders every read before the next
+    // write
+    return PixelBufferRef(frame, [buffer = std::move(buffer), pool, generation, share_tag](const PixelBuffer*) mutable {
+        auto state = pool.lock();
+        if (!state) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (state->generation == generation && state->free.size() < state->max_free) {
+            state->free.push_back(FreeBuffer{std::move(buffer), share_tag});
+        }
+    });
+}
+
+void PixelBufferPool::clear() {
+    std::vector<FreeBuffer> free;
+    std::lock_guard<std::mutex> lock(state->mutex);
+    free.swap(state->free);
+    ++state->generation;
+}
+
+size_t PixelBufferPool::free_bytes() const {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    size_t bytes = 0;
+    for (const auto& free : state->free) {
+        bytes += free.buffer->bytes();
+    }
+    return bytes;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "ui_types.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// A frame shared by reference from the renderer bridge to the tab that
+// shows it and on to the present step, so it is never copied on the way.
+// The pixels have a mapping of their own: anonymous pages, or a range of a
+// renderer's shared frame that goes back to the bridge with the last
+// reference.
+//
+// Frames are immutable once shared: mutable_data() is only for whoever
+// made the buffer, before handing it out (see PixelBufferPool).
+class PixelBuffer {
+public:
+    // Zero-filled anonymous pages, rows packed; null if they cannot be mapped
+    static std::shared_ptr<PixelBuffer> allocate(int width, int height, PixelFormat format = PixelFormat::ARGB8888);
+
+    // Pixels mapped by someone else; release runs when no reference is left
+    static std::shared_ptr<PixelBuffer> adopt(uint8_t* pixels, int width, int height, size_t stride,
+                                              PixelFormat format, std::function<void()> release);
+
+    ~PixelBuffer();
+
+    PixelBuffer(const PixelBuffer&) = delete;
+    PixelBuffer& operator=(const PixelBuffer&) = delete;
+
+    int get_width() const { return width; }
+    int get_height() const { return height; }
+    size_t get_stride() const { return stride; } // bytes per row
+    PixelFormat get_format() const { return format; }
+    size_t bytes() const { return stride * height; }
+
+    const uint8_t* data() const { return pixels; }
+    const uint8_t* row(int y) const { return pixels + static_cast<size_t>(y) * stride; }
+    uint8_t* mutable_data() { return pixels; }
+
+private:
+    PixelBuffer(uint8_t* pixels, int width, int height, size_t stride, PixelFormat format,
+                std::function<void()> release);
+
+    uint8_t* pixels;
+    int width;
+    int height;
+    size_t stride;
+    PixelFormat format;
+    std::function<void()> release;
+};
+
+using PixelBufferRef = std::shared_ptr<const PixelBuffer>;
+
+// Buffers to patch frames into, recycled instead of mapped afresh. A buffer
+// from take() is the caller's alone to write; share() hands it out as an
+// immutable frame, and it comes back to the pool only when the frame's last
+// reference is dropped, on whichever thread that happens. A buffer is so
+// never written while anyone else can read it.
+class PixelBufferPool {
+public:
+    explicit PixelBufferPool(size_t max_free = 2);
+
+    PixelBufferPool(const PixelBufferPool&) = delete;
+    PixelBufferPool& operator=(const PixelBufferPool&) = delete;
+
+    // A free buffer of that size and format, preferably the one shared as
+    // preferred_tag, else a fresh zero-filled one. Null if it cannot be
+    // mapped. got_preferred tells whether it was that one.
+    std::shared_ptr<PixelBuffer> take(int width, int height, PixelFormat format, uint64_t preferred_tag = 0,
+                                      bool* got_preferred = nullptr);
+    // tag, if given, gets a number naming this share of the buffer, never
+    // 0 and never given out again, to prefer it by in take() once it is back
+    PixelBufferRef share(std::shared_ptr<PixelBuffer> buffer, uint64_t* tag = nullptr);
+
+    // Unmap the free buffers; those still shared are unmapped when released
+    void clear();
+    size_t free_bytes() const;
+
+private:
+    struct FreeBuffer {
+        std::shared_ptr<PixelBuffer> buffer;
+        uint64_t tag; // of the share it came back from
+    };
+
+    struct State {
+        std::mutex mutex;
+        std::vector<FreeBuffer> free;
+        size_t max_free;
+        uint64_t generation = 0; // bumped by clear()
+        uint64_t last_tag = 0;
+    };
+
+    std::shared_ptr<State> state; // shared frames hold it weakly
+};
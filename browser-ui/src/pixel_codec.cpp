@@ -0,0 +1,218 @@
+#include "pixel_codec.h"
+#include <algorithm>
+
+namespace {
+
+// Rows per independently coded band
+constexpr int BAND_ROWS = 64;
+
+constexpr uint8_t OP_INDEX = 0x00; // 00xxxxxx
+constexpr uint8_t OP_DIFF = 0x40;  // 01xxxxxx
+constexpr uint8_t OP_LUMA = 0x80;  // 10xxxxxx
+constexpr uint8_t OP_RUN = 0xc0;   // 11xxxxxx
+constexpr uint8_t OP_RGB = 0xfe;
+constexpr uint8_t OP_RGBA = 0xff;
+constexpr uint8_t MASK_2 = 0xc0;
+
+// QOI's starting pixel: channels 0, 0, 0, 255
+constexpr uint32_t START_PIXEL = 0xff000000u;
+
+// Channel c of a pixel word; QOI's r, g, b, a are channels 0..3
+inline int channel(uint32_t pixel, int c) {
+    return (pixel >> (8 * c)) & 0xff;
+}
+
+inline uint32_t with_channels(int c0, int c1, int c2, int c3) {
+    return static_cast<uint32_t>(c0 & 0xff) | static_cast<uint32_t>(c1 & 0xff) << 8 |
+           static_cast<uint32_t>(c2 & 0xff) << 16 | static_cast<uint32_t>(c3 & 0xff) << 24;
+}
+
+inline int hash(uint32_t pixel) {
+    return (channel(pixel, 0) * 3 + channel(pixel, 1) * 5 + channel(pixel, 2) * 7 + channel(pixel, 3) * 11) % 64;
+}
+
+// Rows are one stream: runs carry on from one row to the next
+void encode_band(const uint8_t* first_row, size_t stride, int width, int rows, std::vector<uint8_t>& out) {
+    out.reserve(static_cast<size_t>(width) * rows / 8 + 16);
+    uint32_t index[64] = {};
+    uint32_t prev = START_PIXEL;
+    size_t run = 0;
+    auto flush_run = [&] {
+        while (run > 0) {
+            const size_t n = std::min<size_t>(run, 62);
+            out.push_back(static_cast<uint8_t>(OP_RUN | (n - 1)));
+            run -= n;
+        }
+    };
+
+    for (int y = 0; y < rows; ++y) {
+        const uint32_t* pixels = reinterpret_cast<const uint32_t*>(first_row + static_cast<size_t>(y) * stride);
+        int i = 0;
+        while (i < width) {
+            if (pixels[i] == prev) {
+                const int start = i;
+                while (i < width && pixels[i] == prev) {
+                    ++i;
+                }
+                run += i - start;
+                continue;
+            }
+            flush_run();
+
+            const uint32_t px = pixels[i++];
+            const int slot = hash(px);
+            if (index[slot] == px) {
+                out.push_back(static_cast<uint8_t>(OP_INDEX | slot));
+            } else {
+                index[slot] = px;
+                if (channel(px, 3) == channel(prev, 3)) {
+                    const int dr = static_cast<int8_t>(channel(px, 0) - channel(prev, 0));
+                    const int dg = static_cast<int8_t>(channel(px, 1) - channel(prev, 1));
+                    const int db = static_cast<int8_t>(channel(px, 2) - channel(prev, 2));
+                    const int dr_dg = dr - dg;
+                    const int db_dg = db - dg;
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                        out.push_back(static_cast<uint8_t>(OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+                    } else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+                        out.push_back(static_cast<uint8_t>(OP_LUMA | (dg + 32)));
+                        out.push_back(static_cast<uint8_t>((dr_dg + 8) << 4 | (db_dg + 8)));
+                    } else {
+                        const uint8_t op[4] = {OP_RGB, static_cast<uint8_t>(channel(px, 0)),
+                                               static_cast<uint8_t>(channel(px, 1)), static_cast<uint8_t>(channel(px, 2))};
+                        out.insert(out.end(), op, op + 4);
+                    }
+                } else {
+                    out.push_back(OP_RGBA);
+                    for (int c = 0; c < 4; ++c) {
+                        out.push_back(static_cast<uint8_t>(channel(px, c)));
+                    }
+                }
+            }
+            prev = px;
+        }
+    }
+    flush_run();
+}
+
+bool decode_band(const uint8_t* data, size_t size, uint32_t* pixels, size_t count) {
+    uint32_t index[64] = {};
+    uint32_t px = START_PIXEL;
+    size_t pos = 0;
+    size_t i = 0;
+    while (i < count) {
+        if (pos >= size) {
+            return false;
+        }
+        const uint8_t b1 = data[pos++];
+        if (b1 == OP_RGB) {
+            if (size - pos < 3) {
+                return false;
+            }
+            px = with_channels(data[pos], data[pos + 1], data[pos + 2], channel(px, 3));
+            pos += 3;
+        } else if (b1 == OP_RGBA) {
+            if (size - pos < 4) {
+                return false;
+            }
+            px = with_channels(data[pos], data[pos + 1], data[pos + 2], data[pos + 3]);
+            pos += 4;
+        } else {
+            switch (b1 & MASK_2) {
+                case OP_INDEX:
+                    px = index[b1];
+                    break;
+                case OP_DIFF:
+                    px = with_channels(channel(px, 0) + ((b1 >> 4) & 0x03) - 2,
+                                       channel(px, 1) + ((b1 >> 2) & 0x03) - 2,
+                                       channel(px, 2) + (b1 & 0x03) - 2, channel(px, 3));
+                    break;
+                case OP_LUMA: {
+                    if (pos >= size) {
+                        return false;
+                    }
+                    const uint8_t b2 = data[pos++];
+                    const int dg = (b1 & 0x3f) - 32;
+                    px = with_channels(channel(px, 0) + dg - 8 + ((b2 >> 4) & 0x0f), channel(px, 1) + dg,
+                                       channel(px, 2) + dg - 8 + (b2 & 0x0f), channel(px, 3));
+                    break;
+                }
+                default: { // OP_RUN: px is unchanged, and already indexed
+                    const size_t n = std::min<size_t>((b1 & 0x3f) + 1u, count - i);
+                    std::fill_n(pixels + i, n, px);
+                    i += n;
+                    continue;
+                }
+            }
+        }
+        index[hash(px)] = px;
+        pixels[i++] = px;
+    }
+    return pos == size;
+}
+
+} // namespace
+
+CompressedPixels compress_pixels(const uint8_t* pixels, int width, int height, size_t stride,
+                                 WorkStealingPool* pool) {
+    CompressedPixels compressed;
+    if (width <= 0 || height <= 0) {
+        return compressed;
+    }
+    compressed.width = width;
+    compressed.height = height;
+
+    const size_t bands = (height + BAND_ROWS - 1) / BAND_ROWS;
+    std::vector<std::vector<uint8_t>> coded(bands);
+    auto encode = [&](size_t band) {
+        const int row = static_cast<int>(band) * BAND_ROWS;
+        const int rows = std::min(BAND_ROWS, height - row);
+        encode_band(pixels + static_cast<size_t>(row) * stride, stride, width, rows, coded[band]);
+    };
+    if (pool) {
+        pool->run(bands, encode);
+    } else {
+        for (size_t band = 0; band < bands; ++band) {
+            encode(band);
+        }
+    }
+
+    size_t total = 0;
+    for (const auto& band : coded) {
+        total += band.size();
+    }
+    compressed.data.reserve(total);
+    compressed.band_offsets.reserve(bands + 1);
+    for (const auto& band : coded) {
+        compressed.band_offsets.push_back(compressed.data.size());
+        compressed.data.insert(compressed.data.end(), band.begin(), band.end());
+    }
+    compressed.band_offsets.push_back(compressed.data.size());
+    return compressed;
+}
+
+bool decompress_pixels(const CompressedPixels& compressed, uint8_t* out, WorkStealingPool* pool) {
+    const size_t bands = (compressed.height + BAND_ROWS - 1) / BAND_ROWS;
+    if (compressed.band_offsets.size() != bands + 1) {
+        return false;
+    }
+
+    std::vector<char> ok(bands, 0);
+    auto decode = [&](size_t band) {
+        const int row = static_cast<int>(band) * BAND_ROWS;
+        const int rows = std::min(BAND_ROWS, compressed.height - row);
+        const size_t begin = compressed.band_offsets[band];
+        const size_t end = compressed.band_offsets[band + 1];
+        uint32_t* dst = reinterpret_cast<uint32_t*>(out + static_cast<size_t>(row) * compressed.width * 4);
+        ok[band] = end >= begin && end <= compressed.data.size() &&
+                   decode_band(compressed.data.data() + begin, end - begin, dst,
+                               static_cast<size_t>(rows) * compressed.width);
+    };
+    if (pool) {
+        pool->run(bands, decode);
+    } else {
+        for (size_t band = 0; band < bands; ++band) {
+            decode(band);
+        }
+    }
+    return std::all_of(ok.begin(), ok.end(), [](char band_ok) { return band_ok != 0; });
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "work_pool.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Lossless in-memory compression of 32-bit frames, for tabs in the
+// background. The pixels are coded with QOI's ops (https://qoiformat.org,
+// the same ones renderer/src/codec.rs writes) on the raw bytes, so any
+// 4-byte layout round-trips. Pages are mostly runs of one colour, which
+// cost one byte per 62 pixels and decode as plain fills.
+//
+// The frame is cut into bands of rows coded independently, so a pool can
+// compress and decompress them in parallel.
+struct CompressedPixels {
+    int width = 0;
+    int height = 0;
+    std::vector<uint8_t> data;
+    std::vector<size_t> band_offsets; // one per band, plus the end of data
+
+    bool empty() const { return band_offsets.empty(); }
+    size_t bytes() const { return data.capacity() + band_offsets.capacity() * sizeof(size_t); }
+};
+
+// Rows are stride bytes apart; pool may be null to work on the calling
+// thread alone
+CompressedPixels compress_pixels(const uint8_t* pixels, int width, int height, size_t stride,
+                                 WorkStealingPool* pool = nullptr);
+
+// Decode into out, width * height * 4 bytes with rows packed; false if the
+// data is corrupt
+bool decompress_pixels(const CompressedPixels& compressed, uint8_t* out, WorkStealingPool* pool = nullptr);
@@ -0,0 +1,121 @@
+#include "present.h"
+#include "compositor.h"
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Composite one row of premultiplied src source-over onto the matching
+// row of backdrop (the chrome framebuffer) and store it at dst on the
+// surface, so translucent content shows the chrome behind it rather than
+// stale surface pixels. scratch is used for surfaces not in ARGB8888.
+void composite_row(const SDL_Surface* surface, uint8_t* dst, const uint32_t* backdrop, const uint32_t* src, int w,
+                   std::vector<uint32_t>& scratch) {
+    const uint32_t format = surface->format->format;
+    const bool direct = format == SDL_PIXELFORMAT_ARGB8888 || format == SDL_PIXELFORMAT_RGB888;
+    if (!direct && scratch.size() < static_cast<size_t>(w)) {
+        scratch.resize(static_cast<size_t>(w));
+    }
+    uint32_t* out = direct ? reinterpret_cast<uint32_t*>(dst) : scratch.data();
+    std::memcpy(out, backdrop, static_cast<size_t>(w) * 4);
+    blend_span(out, src, static_cast<size_t>(w), BlendMode::SOURCE_OVER);
+    if (!direct) {
+        SDL_ConvertPixels(w, 1, SDL_PIXELFORMAT_ARGB8888, out, w * 4, format, dst, surface->pitch);
+    }
+}
+
+} // namespace
+
+void blit_argb(SDL_Surface* surface, const uint8_t* src, size_t src_pitch, int x, int y, int w, int h) {
+    w = std::min(w, surface->w - x);
+    h = std::min(h, surface->h - y);
+    if (x < 0 || y < 0 || w <= 0 || h <= 0) {
+        return;
+    }
+
+    uint8_t* dst = static_cast<uint8_t*>(surface->pixels) + static_cast<size_t>(y) * surface->pitch +
+                   static_cast<size_t>(x) * surface->format->BytesPerPixel;
+    const uint32_t format = surface->format->format;
+    if (format == SDL_PIXELFORMAT_ARGB8888 || format == SDL_PIXELFORMAT_RGB888) {
+        for (int row = 0; row < h; ++row) {
+            std::memcpy(dst + static_cast<size_t>(row) * surface->pitch, src + row * src_pitch,
+                        static_cast<size_t>(w) * 4);
+        }
+        return;
+    }
+    SDL_ConvertPixels(w, h, SDL_PIXELFORMAT_ARGB8888, src, static_cast<int>(src_pitch), format, dst, surface->pitch);
+}
+
+void composite_argb(SDL_Surface* surface, const uint32_t* backdrop, size_t backdrop_stride, const uint8_t* src,
+                    size_t src_pitch, int x, int y, int w, int h, std::vector<uint32_t>& scratch) {
+    w = std::min(w, surface->w - x);
+    h = std::min(h, surface->h - y);
+    if (x < 0 || y < 0 || w <= 0 || h <= 0) {
+        return;
+    }
+
+    uint8_t* dst = static_cast<uint8_t*>(surface->pixels) + static_cast<size_t>(y) * surface->pitch +
+                   static_cast<size_t>(x) * surface->format->BytesPerPixel;
+    for (int row = 0; row < h; ++row) {
+        composite_row(surface, dst + static_cast<size_t>(row) * surface->pitch,
+                      &backdrop[static_cast<size_t>(y + row) * backdrop_stride + x],
+                      reinterpret_cast<const uint32_t*>(src + row * src_pitch), w, scratch);
+    }
+}
+
+void composite_scaled_argb(SDL_Surface* surface, const uint32_t* backdrop, size_t backdrop_stride,
+                           const uint8_t* src, int src_width, int src_height, size_t src_pitch, int x, int y,
+                           int w, int h, std::vector<int32_t>& columns, std::vector<uint32_t>& row,
+                           std::vector<uint32_t>& scratch) {
+    const int visible_w = std::min(w, surface->w - x);
+    const int visible_h = std::min(h, surface->h - y);
+    if (x < 0 || y < 0 || visible_w <= 0 || visible_h <= 0 || src_width <= 0 || src_height <= 0) {
+        return;
+    }
+
+    // Sample at the centre of each destination pixel
+    columns.resize(static_cast<size_t>(visible_w));
+    for (int i = 0; i < visible_w; ++i) {
+        columns[i] = static_cast<int32_t>(std::min<int64_t>(src_width - 1, (2 * int64_t{i} + 1) * src_width / (2 * w)));
+    }
+    row.resize(static_cast<size_t>(visible_w));
+
+    uint8_t* dst = static_cast<uint8_t*>(surface->pixels) + static_cast<size_t>(y) * surface->pitch +
+                   static_cast<size_t>(x) * surface->format->BytesPerPixel;
+    for (int r = 0; r < visible_h; ++r) {
+        const int64_t sy = std::min<int64_t>(src_height - 1, (2 * int64_t{r} + 1) * src_height / (2 * h));
+        gather_span(row.data(), reinterpret_cast<const uint32_t*>(src + sy * src_pitch), columns.data(),
+                    static_cast<size_t>(visible_w));
+        composite_row(surface, dst + static_cast<size_t>(r) * surface->pitch,
+                      &backdrop[static_cast<size_t>(y + r) * backdrop_stride + x], row.data(), visible_w, scratch);
+    }
+}
+
+void overlay_argb(SDL_Surface* surface, const uint32_t* src, size_t src_stride, int x, int y, int w, int h,
+                  std::vector<uint32_t>& scratch) {
+    w = std::min(w, surface->w - x);
+    h = std::min(h, surface->h - y);
+    if (x < 0 || y < 0 || w <= 0 || h <= 0) {
+        return;
+    }
+
+    const uint32_t format = surface->format->format;
+    const bool direct = format == SDL_PIXELFORMAT_ARGB8888 || format == SDL_PIXELFORMAT_RGB888;
+    if (!direct && scratch.size() < static_cast<size_t>(w)) {
+        scratch.resize(static_cast<size_t>(w));
+    }
+    uint8_t* dst = static_cast<uint8_t*>(surface->pixels) + static_cast<size_t>(y) * surface->pitch +
+                   static_cast<size_t>(x) * surface->format->BytesPerPixel;
+    for (int row = 0; row < h; ++row) {
+        uint8_t* line = dst + static_cast<size_t>(row) * surface->pitch;
+        uint32_t* out = direct ? reinterpret_cast<uint32_t*>(line) : scratch.data();
+        if (!direct) {
+            SDL_ConvertPixels(w, 1, format, line, surface->pitch, SDL_PIXELFORMAT_ARGB8888, out, w * 4);
+        }
+        blend_span(out, &src[static_cast<size_t>(row) * src_stride], static_cast<size_t>(w), BlendMode::SOURCE_OVER);
+        if (!direct) {
+            SDL_ConvertPixels(w, 1, SDL_PIXELFORMAT_ARGB8888, out, w * 4, format, line, surface->pitch);
+        }
+    }
+}
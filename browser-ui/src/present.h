@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct SDL_Surface;
+
+// Moving UI pixels onto the window surface. Sources are ARGB8888, rows
+// src_pitch bytes apart, and are clipped to the surface. Surfaces in
+// ARGB8888 or XRGB8888 are written directly; anything else goes through
+// SDL's converter.
+
+// Copy a w x h block of ARGB8888 pixels to (x, y) as-is
+void blit_argb(SDL_Surface* surface, const uint8_t* src, size_t src_pitch, int x, int y, int w, int h);
+
+// Composite a w x h block of premultiplied ARGB8888 pixels source-over to
+// (x, y). The backdrop (the chrome framebuffer, backdrop_stride pixels per
+// row, in surface coordinates) is what shows through, rather than stale
+// surface pixels. scratch is used for surfaces that need converting.
+void composite_argb(SDL_Surface* surface, const uint32_t* backdrop, size_t backdrop_stride, const uint8_t* src,
+                    size_t src_pitch, int x, int y, int w, int h, std::vector<uint32_t>& scratch);
+
+// Blend a w x h block of premultiplied ARGB8888 pixels, src_stride pixels
+// per row, source-over onto whatever the surface shows at (x, y)
+void overlay_argb(SDL_Surface* surface, const uint32_t* src, size_t src_stride, int x, int y, int w, int h,
+                  std::vector<uint32_t>& scratch);
+
+// Like composite_argb, but stretches a src_width x src_height image (rows
+// src_pitch bytes apart) over the whole w x h block with nearest-neighbour sampling. columns and row
+// are scratch buffers kept by the caller, so a window drag does not
+// allocate per frame.
+void composite_scaled_argb(SDL_Surface* surface, const uint32_t* backdrop, size_t backdrop_stride,
+                           const uint8_t* src, int src_width, int src_height, size_t src_pitch, int x, int y,
+                           int w, int h, std::vector<int32_t>& columns, std::vector<uint32_t>& row,
+                           std::vector<uint32_t>& scratch);
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Binary framed protocol between RendererBridge and `renderer --serve`,
+// carried over the renderer's stdin/stdout. All fields are little-endian;
+// layouts must stay in sync with renderer/src/protocol.rs.
+//
+// Each message is a FrameHeader followed by payload_len bytes of payload:
+//   RENDER_JOB  RenderJobHeader + HTML document bytes
+//   CANCEL      no payload, job_id names the job to drop
+//   RESULT      ResultHeader + rect_count DamageRects (+ UTF-8 error text
+//               when status is ERROR)
+//   TRACE       u32 span_count, then per span u64 start_ns, u64 end_ns,
+//               u32 name_len and the UTF-8 name
+// Every RENDER_JOB is answered by exactly one RESULT, cancelled or not. A
+// job sent with JOB_FLAG_TRACE may get a TRACE first: the renderer's own
+// spans for it, in CLOCK_MONOTONIC nanoseconds like the UI's trace.
+//
+// A job names its surface (tab) and the job whose frame the UI currently
+// shows there. When the renderer still holds that frame it answers with
+// RESULT_FLAG_DAMAGE: only the pixels inside the damage rects are valid in
+// the shared frame and everything else is unchanged since base_job_id.
+//
+// The shared frame holds many frames: those the UI still shows stay where
+// they are, and each job names the free range (frame_offset) to paint in.
+namespace RenderProtocol {
+
+constexpr uint32_t MAGIC = 0x50525153; // "SQRP"
+
+enum class MessageType : uint16_t {
+    RENDER_JOB = 1,
+    CANCEL = 2,
+    RESULT = 3,
+    TRACE = 4,
+};
+
+enum class Status : uint32_t {
+    OK = 0,
+    ERROR = 1,
+    CANCELLED = 2,
+};
+
+enum class PixelFormat : uint32_t {
+    RGBA8888 = 1,        // bytes R,G,B,A, straight alpha
+    BGRA8888_PREMUL = 2, // bytes B,G,R,A premultiplied: native ARGB8888 on little-endian
+};
+
+constexpr uint16_t JOB_FLAG_TRACE = 1;
+constexpr uint16_t RESULT_FLAG_DAMAGE = 1;
+
+// Fixed part of each span in a TRACE payload, before its name
+constexpr size_t TRACE_SPAN_HEADER_LEN = 20;
+
+struct FrameHeader {
+    uint32_t magic;
+    uint16_t type;
+    uint16_t flags;
+    uint32_t job_id;
+    uint32_t payload_len;
+};
+
+struct RenderJobHeader {
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixel_format;
+    uint32_t surface_id;     // tab the frame belongs to, 0 for none
+    uint64_t frame_capacity; // bytes of the shared frame the renderer may map
+    uint32_t base_job_id;    // job whose frame the surface shows, 0 for none
+    uint32_t reserved;
+    uint64_t frame_offset; // where in the shared frame to paint
+};
+
+struct ResultHeader {
+    uint32_t status;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint32_t pixel_format;
+    uint32_t rect_count;   // DamageRects following this header
+    uint64_t frame_offset; // where the pixels start in the shared frame
+};
+
+struct DamageRect {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+};
+
+static_assert(sizeof(FrameHeader) == 16, "FrameHeader layout");
+static_assert(sizeof(RenderJobHeader) == 40, "RenderJobHeader layout");
+static_assert(sizeof(ResultHeader) == 32, "ResultHeader layout");
+static_assert(sizeof(DamageRect) == 16, "DamageRect layout");
+
+inline FrameHeader make_header(MessageType type, uint32_t job_id, uint32_t payload_len) {
+    return FrameHeader{MAGIC, static_cast<uint16_t>(type), 0, job_id, payload_len};
+}
+
+} // namespace RenderProtocol
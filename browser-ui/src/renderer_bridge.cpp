@@ -1,66 +1,633 @@
 #include "renderer_bridge.h"
-#include "bmp_loader.h"
+#include "render_protocol.h"
+#include "trace.h"
 #include <iostream>
+#include <algorithm>
 #include <cstdlib>
-#include <sstream>
+#include <cstring>
+#include <csignal>
+#include <cerrno>
+#include <map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 
-RendererBridge::RendererBridge() {
-    setup_ipc();
+namespace {
+
+const char* renderer_path() {
+    const char* override_path = std::getenv("SQU1D_RENDERER");
+    return override_path ? override_path
+                         : "/home/qchef/Documents/squ1dbrowser/renderer/target/release/renderer";
 }
 
-RendererBridge::~RendererBridge() {}
+bool write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
 
-bool RendererBridge::setup_ipc() {
-    std::cout << "IPC bridge initialized" << std::endl;
+bool read_all(int fd, void* data, size_t len) {
+    char* out = static_cast<char*>(data);
+    while (len > 0) {
+        ssize_t n = read(fd, out, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        out += n;
+        len -= static_cast<size_t>(n);
+    }
     return true;
 }
 
-bool RendererBridge::request_render(const std::string& url, int width, int height) {
-    std::cout << "Render request: " << url << " (" << width << "x" << height << ")" << std::endl;
-    
-    // For now, render a simple test HTML that mentions the URL
-    std::string html = "<html><body><h1>Loading: " + url + "</h1><p>Page content would appear here.</p></body></html>";
-    
-    // Call the Rust renderer process with absolute path
-    std::stringstream cmd;
-    cmd << "/home/qchef/Documents/squ1dbrowser/renderer/target/release/renderer \"" << html << "\" " 
-        << width << " " << height << " /tmp/squ1d_render.bmp 2>/dev/null";
-    
-    int ret = system(cmd.str().c_str());
-    if (ret != 0) {
-        std::cerr << "Renderer invocation failed with code " << ret << std::endl;
+size_t page_round(size_t bytes) {
+    static const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return (bytes + page - 1) / page * page;
+}
+
+} // namespace
+
+// The memfd one renderer paints into, carved into ranges: one per frame
+// still alive, plus the one a job is painting. Freed ranges are reused
+// first-fit; all but one frame's worth of them is punched out so the
+// memory goes back to the system. The memfd itself only grows, as the
+// renderer expects. Frames are released on whatever thread drops them
+// last, hence the mutex.
+class FrameArena {
+public:
+    FrameArena() : fd(memfd_create("squ1d-frame", MFD_CLOEXEC)) {
+        if (fd < 0) {
+            std::cerr << "memfd_create failed: " << std::strerror(errno) << std::endl;
+        }
+    }
+
+    ~FrameArena() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    int get_fd() const { return fd; }
+
+    size_t get_capacity() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return capacity;
+    }
+
+    // Take a free range of bytes (page-rounded) for a job to paint into
+    bool reserve(size_t bytes, size_t& offset) {
+        bytes = page_round(bytes);
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = free_ranges.begin(); it != free_ranges.end(); ++it) {
+            if (it->second >= bytes) {
+                offset = it->first;
+                if (it->second > bytes) {
+                    free_ranges[offset + bytes] = it->second - bytes;
+                }
+                free_ranges.erase(it);
+                free_bytes -= bytes;
+                return true;
+            }
+        }
+
+        // Grow, starting in the free range at the end if there is one
+        offset = capacity;
+        size_t reused = 0;
+        if (!free_ranges.empty()) {
+            auto last = std::prev(free_ranges.end());
+            if (last->first + last->second == capacity) {
+                offset = last->first;
+                reused = last->second;
+            }
+        }
+        const size_t grown = offset + bytes;
+        if (ftruncate(fd, static_cast<off_t>(grown)) != 0) {
+            std::cerr << "Failed to grow render frame: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        if (reused) {
+            free_ranges.erase(offset);
+            free_bytes -= reused;
+        }
+        capacity = grown;
+        return true;
+    }
+
+    void release(size_t offset, size_t bytes) {
+        bytes = page_round(bytes);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (free_bytes >= bytes) {
+            fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(offset),
+                      static_cast<off_t>(bytes));
+        }
+        free_bytes += bytes;
+
+        // Merge with the neighbours
+        auto next = free_ranges.lower_bound(offset);
+        if (next != free_ranges.end() && offset + bytes == next->first) {
+            bytes += next->second;
+            next = free_ranges.erase(next);
+        }
+        if (next != free_ranges.begin()) {
+            auto before = std::prev(next);
+            if (before->first + before->second == offset) {
+                before->second += bytes;
+                return;
+            }
+        }
+        free_ranges[offset] = bytes;
+    }
+
+private:
+    const int fd;
+    std::mutex mutex;
+    size_t capacity = 0;
+    size_t free_bytes = 0;
+    std::map<size_t, size_t> free_ranges; // offset -> bytes
+};
+
+RendererBridge::RendererBridge(int worker_count) {
+    // A dead renderer must surface as a failed write, not kill the UI.
+    std::signal(SIGPIPE, SIG_IGN);
+
+    if (worker_count <= 0) {
+        worker_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Spawn every renderer up front so the first navigation in a new tab
+    // finds a warm process
+    for (int i = 0; i < worker_count; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+        setup_ipc(*workers.back());
+    }
+    for (auto& worker : workers) {
+        worker->thread = std::thread(&RendererBridge::worker_loop, this, std::ref(*worker));
+    }
+
+    std::cout << "IPC bridge initialized with " << workers.size() << " renderer(s)" << std::endl;
+}
+
+RendererBridge::~RendererBridge() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    job_ready.notify_all();
+    job_done.notify_all();
+
+    for (auto& worker : workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+        shutdown_renderer(*worker);
+    }
+}
+
+bool RendererBridge::setup_ipc(Worker& worker) {
+    worker.arena = std::make_shared<FrameArena>();
+    if (worker.arena->get_fd() < 0) {
+        return false;
+    }
+
+    return spawn_renderer(worker);
+}
+
+bool RendererBridge::spawn_renderer(Worker& worker) {
+    int to_child[2];
+    int from_child[2];
+    if (pipe2(to_child, O_CLOEXEC) != 0) {
+        std::cerr << "Failed to create renderer pipe: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    if (pipe2(from_child, O_CLOEXEC) != 0) {
+        std::cerr << "Failed to create renderer pipe: " << std::strerror(errno) << std::endl;
+        close(to_child[0]);
+        close(to_child[1]);
+        return false;
+    }
+
+    // Everything the child needs is prepared before fork()
+    const char* path = renderer_path();
+    const int frame_fd = worker.arena->get_fd();
+    std::string fd_arg = std::to_string(frame_fd);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(to_child[0], STDIN_FILENO);
+        dup2(from_child[1], STDOUT_FILENO);
+        fcntl(frame_fd, F_SETFD, 0); // let the frame survive exec
+        execl(path, path, "--serve", fd_arg.c_str(), static_cast<char*>(nullptr));
+        _exit(127);
+    }
+
+    close(to_child[0]);
+    close(from_child[1]);
+
+    if (pid < 0) {
+        std::cerr << "Failed to spawn renderer: " << std::strerror(errno) << std::endl;
+        close(to_child[1]);
+        close(from_child[0]);
         return false;
     }
-    
+
+    worker.renderer_pid = pid;
+    worker.request_fd = to_child[1];
+    worker.reply_fd = from_child[0];
     return true;
 }
 
-std::vector<uint8_t> RendererBridge::get_rendered_content() const {
-    // Load the BMP that was just rendered
-    BMPLoader::Image img = BMPLoader::load("/tmp/squ1d_render.bmp");
-    
-    if (img.pixels.empty()) {
-        std::cerr << "Failed to load rendered content from BMP" << std::endl;
-        return std::vector<uint8_t>();
+void RendererBridge::shutdown_renderer(Worker& worker) {
+    if (worker.request_fd >= 0) {
+        close(worker.request_fd); // EOF on stdin tells the renderer to exit
+        worker.request_fd = -1;
+    }
+    if (worker.reply_fd >= 0) {
+        close(worker.reply_fd);
+        worker.reply_fd = -1;
+    }
+    if (worker.renderer_pid > 0) {
+        waitpid(worker.renderer_pid, nullptr, 0);
+        worker.renderer_pid = -1;
     }
-    
-    return img.pixels;
 }
 
-std::vector<uint8_t> RendererBridge::render_html(const std::string& html, int width, int height) {
-    // Invoke renderer
-    if (!request_render(html, width, height)) {
-        // Return white background on error
-        std::vector<uint8_t> pixels(width * height * 4);
-        for (size_t i = 0; i < pixels.size(); i += 4) {
-            pixels[i + 0] = 255;     // R
-            pixels[i + 1] = 255;     // G
-            pixels[i + 2] = 255;     // B
-            pixels[i + 3] = 255;     // A
+bool RendererBridge::send_render(Worker& worker, const RenderJob& job, size_t frame_offset, size_t frame_bytes,
+                                 RenderCompletion& completion) {
+    using namespace RenderProtocol;
+
+    // Frame header and job header go out in one write, the document follows
+    // as-is: no argv limits, no quoting.
+    struct {
+        FrameHeader frame;
+        RenderJobHeader job;
+    } request;
+    request.frame = make_header(MessageType::RENDER_JOB, job.job_id,
+                                static_cast<uint32_t>(sizeof(RenderJobHeader) + job.document.size()));
+    if (Trace::ENABLED) {
+        request.frame.flags |= JOB_FLAG_TRACE;
+    }
+    request.job = RenderJobHeader{static_cast<uint32_t>(job.width), static_cast<uint32_t>(job.height),
+                                  static_cast<uint32_t>(RenderProtocol::PixelFormat::BGRA8888_PREMUL),
+                                  static_cast<uint32_t>(std::max(job.tab_id, 0)), worker.arena->get_capacity(),
+                                  job.base_job_id, 0, frame_offset};
+    static_assert(sizeof(request) == sizeof(FrameHeader) + sizeof(RenderJobHeader), "request packing");
+
+    {
+        std::lock_guard<std::mutex> lock(worker.write_mutex);
+        if (!write_all(worker.request_fd, reinterpret_cast<const char*>(&request), sizeof(request)) ||
+            !write_all(worker.request_fd, job.document.data(), job.document.size())) {
+            return false;
+        }
+    }
+
+    FrameHeader reply;
+    if (!read_all(worker.reply_fd, &reply, sizeof(reply)) || reply.magic != MAGIC) {
+        return false;
+    }
+    if (reply.type == static_cast<uint16_t>(MessageType::TRACE)) {
+        // The renderer's spans for this job come just before its result
+        if (reply.job_id != job.job_id || !read_trace(worker, reply.payload_len) ||
+            !read_all(worker.reply_fd, &reply, sizeof(reply)) || reply.magic != MAGIC) {
+            return false;
+        }
+    }
+    if (reply.type != static_cast<uint16_t>(MessageType::RESULT) || reply.job_id != job.job_id ||
+        reply.payload_len < sizeof(ResultHeader)) {
+        return false;
+    }
+
+    ResultHeader result;
+    if (!read_all(worker.reply_fd, &result, sizeof(result)) ||
+        reply.payload_len - sizeof(ResultHeader) < static_cast<uint64_t>(result.rect_count) * sizeof(DamageRect)) {
+        return false;
+    }
+    std::vector<DamageRect> rects(result.rect_count);
+    std::string message(reply.payload_len - sizeof(ResultHeader) - rects.size() * sizeof(DamageRect), '\0');
+    if (!read_all(worker.reply_fd, rects.data(), rects.size() * sizeof(DamageRect)) ||
+        !read_all(worker.reply_fd, &message[0], message.size())) {
+        return false;
+    }
+
+    if (result.status == static_cast<uint32_t>(Status::CANCELLED)) {
+        return true;
+    }
+    if (result.status != static_cast<uint32_t>(Status::OK)) {
+        std::cerr << "Renderer failed job " << job.job_id << ": " << message << std::endl;
+        return true; // renderer is alive, the page just failed
+    }
+
+    if (result.width != static_cast<uint32_t>(job.width) || result.height != static_cast<uint32_t>(job.height) ||
+        result.pixel_format != static_cast<uint32_t>(RenderProtocol::PixelFormat::BGRA8888_PREMUL) ||
+        result.stride < result.width * 4 || result.frame_offset != frame_offset ||
+        static_cast<uint64_t>(result.stride) * result.height > frame_bytes) {
+        std::cerr << "Renderer returned an inconsistent frame for job " << job.job_id << std::endl;
+        return true;
+    }
+    const bool partial = reply.flags & RESULT_FLAG_DAMAGE;
+    if (!partial) {
+        rects.clear(); // a whole frame: nothing to patch
+    }
+    for (const DamageRect& rect : rects) {
+        if (rect.width > result.width || rect.x > result.width - rect.width ||
+            rect.height > result.height || rect.y > result.height - rect.height) {
+            std::cerr << "Renderer returned an inconsistent frame for job " << job.job_id << std::endl;
+            return true;
+        }
+    }
+
+    // The frame stays where the renderer painted it; the range is ours
+    // until the last reference to the frame goes
+    TRACE_SCOPE("map_frame");
+    void* mapped = mmap(nullptr, frame_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        worker.arena->get_fd(), static_cast<off_t>(frame_offset));
+    if (mapped == MAP_FAILED) {
+        std::cerr << "Failed to map render frame: " << std::strerror(errno) << std::endl;
+        return true;
+    }
+    std::shared_ptr<FrameArena> arena = worker.arena;
+    auto release = [arena, mapped, frame_offset, frame_bytes] {
+        munmap(mapped, frame_bytes);
+        arena->release(frame_offset, frame_bytes);
+    };
+    completion.frame = PixelBuffer::adopt(static_cast<uint8_t*>(mapped), job.width, job.height, result.stride,
+                                          ::PixelFormat::ARGB8888, release);
+    if (partial) {
+        completion.damage.reserve(rects.size());
+        for (const DamageRect& rect : rects) {
+            completion.damage.push_back(PixelRect{static_cast<int>(rect.x), static_cast<int>(rect.y),
+                                                  static_cast<int>(rect.width), static_cast<int>(rect.height)});
+        }
+        completion.partial = true;
+        completion.base_job_id = job.base_job_id;
+    }
+    completion.ok = true;
+    return true;
+}
+
+bool RendererBridge::read_trace(Worker& worker, uint32_t payload_len) {
+    using namespace RenderProtocol;
+
+    std::vector<uint8_t> payload(payload_len);
+    if (!read_all(worker.reply_fd, payload.data(), payload.size())) {
+        return false;
+    }
+
+    // Malformed spans are dropped; the connection itself is still in sync
+    auto u32_at = [&](size_t at) {
+        uint32_t v;
+        std::memcpy(&v, &payload[at], 4);
+        return v;
+    };
+    auto u64_at = [&](size_t at) {
+        uint64_t v;
+        std::memcpy(&v, &payload[at], 8);
+        return v;
+    };
+    if (payload.size() < 4) {
+        return true;
+    }
+    const uint32_t count = u32_at(0);
+    size_t at = 4;
+    for (uint32_t i = 0; i < count && payload.size() - at >= TRACE_SPAN_HEADER_LEN; ++i) {
+        const uint64_t start_ns = u64_at(at);
+        const uint64_t end_ns = u64_at(at + 8);
+        const uint32_t name_len = u32_at(at + 16);
+        at += TRACE_SPAN_HEADER_LEN;
+        if (payload.size() - at < name_len) {
+            break;
+        }
+        Trace::record_external(worker.renderer_pid,
+                               std::string(reinterpret_cast<const char*>(&payload[at]), name_len), start_ns,
+                               end_ns);
+        at += name_len;
+    }
+    return true;
+}
+
+void RendererBridge::send_cancel(Worker& worker, uint32_t job_id) {
+    RenderProtocol::FrameHeader cancel = RenderProtocol::make_header(RenderProtocol::MessageType::CANCEL, job_id, 0);
+    std::lock_guard<std::mutex> lock(worker.write_mutex);
+    if (worker.request_fd >= 0) {
+        write_all(worker.request_fd, reinterpret_cast<const char*>(&cancel), sizeof(cancel));
+    }
+}
+
+void RendererBridge::run_job(Worker& worker, const RenderJob& job, RenderCompletion& completion) {
+    TRACE_SCOPE("render_job");
+    std::cout << "Render request: " << job.url << " (" << job.width << "x" << job.height << ")" << std::endl;
+
+    // A free range of the arena to paint in. Once a frame maps it, the
+    // frame gives it back; otherwise it goes back as soon as we are done.
+    const size_t frame_bytes = page_round(static_cast<size_t>(job.width) * job.height * 4);
+    size_t frame_offset = 0;
+    if (job.width <= 0 || job.height <= 0 || !worker.arena || worker.arena->get_fd() < 0 ||
+        !worker.arena->reserve(frame_bytes, frame_offset)) {
+        return;
+    }
+    struct RangeGuard {
+        FrameArena& arena;
+        const RenderCompletion& completion;
+        size_t offset, bytes;
+        ~RangeGuard() {
+            if (!completion.frame) {
+                arena.release(offset, bytes);
+            }
+        }
+    } guard{*worker.arena, completion, frame_offset, frame_bytes};
+
+    // Restart the renderer once if it died since the last request
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        if (worker.renderer_pid < 0) {
+            std::lock_guard<std::mutex> lock(worker.write_mutex);
+            if (!spawn_renderer(worker)) {
+                return;
+            }
+        }
+        if (send_render(worker, job, frame_offset, frame_bytes, completion)) {
+            return;
+        }
+        std::cerr << "Renderer connection lost, restarting" << std::endl;
+        std::lock_guard<std::mutex> lock(worker.write_mutex);
+        shutdown_renderer(worker);
+    }
+}
+
+std::deque<RendererBridge::RenderJob>::iterator RendererBridge::next_job_for(const Worker& worker) {
+    // Prefer tabs whose last frame this renderer holds, so it can answer with
+    // damage rects. Leave other tabs to their own renderer while it is idle;
+    // when it is busy, anyone may take them and send a full frame.
+    auto fallback = jobs.end();
+    for (auto it = jobs.begin(); it != jobs.end(); ++it) {
+        auto owner = tab_worker.find(it->tab_id);
+        if (owner != tab_worker.end() && owner->second == &worker) {
+            return it;
+        }
+        if (fallback == jobs.end() && (owner == tab_worker.end() || owner->second->running_job != 0)) {
+            fallback = it;
+        }
+    }
+    return fallback;
+}
+
+void RendererBridge::worker_loop(Worker& worker) {
+    Trace::set_thread_name("bridge");
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        job_ready.wait(lock, [&] { return stopping || next_job_for(worker) != jobs.end(); });
+        if (stopping) {
+            return;
+        }
+
+        auto next = next_job_for(worker);
+        RenderJob job = std::move(*next);
+        jobs.erase(next);
+        worker.running_job = job.job_id;
+        worker.running_tab = job.tab_id;
+        if (job.tab_id >= 0) {
+            tab_worker[job.tab_id] = &worker;
+        }
+        bool more = !jobs.empty();
+        lock.unlock();
+
+        // Jobs held back for this renderer are fair game now that it is busy
+        if (more) {
+            job_ready.notify_all();
+        }
+
+        RenderCompletion completion;
+        completion.job_id = job.job_id;
+        completion.tab_id = job.tab_id;
+        completion.url = job.url;
+        completion.width = job.width;
+        completion.height = job.height;
+        run_job(worker, job, completion);
+
+        lock.lock();
+        worker.running_job = 0;
+        worker.running_tab = -1;
+        if (cancelled.erase(job.job_id) == 0) {
+            completions.push_back(std::move(completion));
+            job_done.notify_all();
+            if (completion_notifier && job.tab_id >= 0) {
+                completion_notifier(); // render_html() waiters are woken above
+            }
         }
-        return pixels;
     }
-    
-    return get_rendered_content();
 }
 
+uint32_t RendererBridge::enqueue(int tab_id, const std::string& url, std::string document, int width, int height,
+                                 uint32_t base_job_id) {
+    Worker* superseded_on = nullptr;
+    uint32_t superseded = 0;
+    uint32_t job_id;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job_id = next_job_id++;
+
+        // A newer navigation replaces whatever this tab was still waiting on
+        if (tab_id >= 0) {
+            for (auto it = jobs.begin(); it != jobs.end();) {
+                it = it->tab_id == tab_id ? jobs.erase(it) : it + 1;
+            }
+            for (auto& worker : workers) {
+                if (worker->running_tab == tab_id && worker->running_job != 0) {
+                    superseded_on = worker.get();
+                    superseded = worker->running_job;
+                    cancelled.insert(superseded);
+                }
+            }
+        }
+
+        jobs.push_back(RenderJob{job_id, tab_id, url, std::move(document), width, height, base_job_id});
+    }
+    job_ready.notify_all(); // the job may be meant for one renderer in particular
+
+    if (superseded_on) {
+        send_cancel(*superseded_on, superseded);
+    }
+    return job_id;
+}
+
+uint32_t RendererBridge::submit_render(int tab_id, const std::string& url, int width, int height,
+                                       uint32_t base_job_id) {
+    TRACE_SCOPE("submit_render");
+    // For now, render a simple test HTML that mentions the URL
+    std::string html = "<html><body><h1>Loading: " + url + "</h1><p>Page content would appear here.</p></body></html>";
+    return enqueue(tab_id, url, std::move(html), width, height, base_job_id);
+}
+
+void RendererBridge::cancel_render(uint32_t job_id) {
+    Worker* running_on = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = jobs.begin(); it != jobs.end(); ++it) {
+            if (it->job_id == job_id) {
+                jobs.erase(it);
+                return;
+            }
+        }
+        for (auto& worker : workers) {
+            if (worker->running_job == job_id) {
+                running_on = worker.get();
+            }
+        }
+        if (!running_on) {
+            return; // already delivered or unknown
+        }
+        cancelled.insert(job_id);
+    }
+    send_cancel(*running_on, job_id);
+}
+
+void RendererBridge::forget_tab(int tab_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    tab_worker.erase(tab_id);
+}
+
+void RendererBridge::poll_completions(std::vector<RenderCompletion>& out) {
+    TRACE_SCOPE("poll_completions");
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto it = completions.begin(); it != completions.end();) {
+        if (it->tab_id < 0) {
+            ++it; // waited on by render_html()
+            continue;
+        }
+        out.push_back(std::move(*it));
+        it = completions.erase(it);
+    }
+}
+
+PixelBufferRef RendererBridge::render_html(const std::string& html, int width, int height) {
+    uint32_t job_id = enqueue(-1, "", html, width, height, 0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    RenderCompletion result;
+    job_done.wait(lock, [&] {
+        for (auto it = completions.begin(); it != completions.end(); ++it) {
+            if (it->job_id == job_id) {
+                result = std::move(*it);
+                completions.erase(it);
+                return true;
+            }
+        }
+        return stopping;
+    });
+
+    if (!result.ok) {
+        // Return white background on error
+        auto white = PixelBuffer::allocate(width, height);
+        if (white) {
+            std::memset(white->mutable_data(), 255, white->bytes());
+        }
+        return white;
+    }
+
+    return std::move(result.frame);
+}
@@ -1,24 +1,133 @@
 #pragma once
 
+#include "ui_types.h"
+#include "pixel_buffer.h"
 #include <string>
 #include <vector>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
 
+// A finished render, handed back to the UI thread by poll_completions().
+struct RenderCompletion {
+    uint32_t job_id = 0;
+    int tab_id = -1;
+    std::string url;
+    bool ok = false;
+    int width = 0;
+    int height = 0;
+    PixelFormat format = PixelFormat::ARGB8888; // premultiplied alpha
+
+    // The frame as the renderer painted it, not copied. With partial set
+    // only the pixels inside the damage rects are to be patched onto the
+    // frame of base_job_id.
+    PixelBufferRef frame;
+    bool partial = false;
+    uint32_t base_job_id = 0;
+    std::vector<PixelRect> damage;
+};
+
+class FrameArena;
+
+// Pool of warm "renderer --serve" children, one worker thread each, sized
+// to the core count. Jobs from every tab share one queue and run in
+// parallel; results are routed back by tab id.
 class RendererBridge {
 public:
-    RendererBridge();
+    // worker_count <= 0 uses one renderer per hardware thread
+    explicit RendererBridge(int worker_count = 0);
     ~RendererBridge();
-    
-    // Send render request to Rust renderer
-    bool request_render(const std::string& url, int width, int height);
-    
-    // Get rendered content
-    std::vector<uint8_t> get_rendered_content() const;
-    
-    // Parse HTML and return rendered pixel data
-    std::vector<uint8_t> render_html(const std::string& html, int width, int height);
-    
+
+    // Queue a render of url for tab_id and return its job id. Never blocks;
+    // any earlier job still queued or running for the same tab is cancelled.
+    // base_job_id names the job whose frame the tab shows; if the renderer
+    // still has it, the completion only carries the damaged rects.
+    uint32_t submit_render(int tab_id, const std::string& url, int width, int height,
+                           uint32_t base_job_id = 0);
+
+    // Drop a queued or running job; its result is never delivered.
+    void cancel_render(uint32_t job_id);
+
+    // Forget which renderer holds a closed tab's last frame. Cancel the
+    // tab's render first, if it has one.
+    void forget_tab(int tab_id);
+
+    // Move every render finished since the last call into out. Never blocks.
+    void poll_completions(std::vector<RenderCompletion>& out);
+
+    // Called on a worker thread whenever a completion becomes available, so
+    // an idle UI loop can be woken. Set before submitting any job.
+    void set_completion_notifier(std::function<void()> notifier) { completion_notifier = std::move(notifier); }
+
+    // Parse HTML and return the rendered ARGB8888 frame (blocks until done)
+    PixelBufferRef render_html(const std::string& html, int width, int height);
+
+    int get_worker_count() const { return static_cast<int>(workers.size()); }
+
 private:
+    struct RenderJob {
+        uint32_t job_id;
+        int tab_id;
+        std::string url;
+        std::string document;
+        int width;
+        int height;
+        uint32_t base_job_id;
+    };
+
+    // One persistent renderer child and the memfd-backed arena it paints
+    // into. Each job paints into a free range of the arena, and a full
+    // frame stays there for as long as a tab shows it. Only the owning
+    // thread talks to the child, except for CANCEL frames which go through
+    // send_cancel() under write_mutex.
+    struct Worker {
+        pid_t renderer_pid = -1;
+        int request_fd = -1;  // renderer stdin, RenderProtocol frames
+        int reply_fd = -1;    // renderer stdout, RenderProtocol frames
+        std::shared_ptr<FrameArena> arena; // outlives us while frames from it are alive
+        std::mutex write_mutex;
+        std::thread thread;
+
+        // Guarded by RendererBridge::mutex
+        uint32_t running_job = 0;
+        int running_tab = -1;
+    };
+
     // IPC communication setup
-    bool setup_ipc();
+    bool setup_ipc(Worker& worker);
+
+    uint32_t enqueue(int tab_id, const std::string& url, std::string document, int width, int height,
+                     uint32_t base_job_id);
+    std::deque<RenderJob>::iterator next_job_for(const Worker& worker);
+    void worker_loop(Worker& worker);
+    void run_job(Worker& worker, const RenderJob& job, RenderCompletion& completion);
+
+    bool spawn_renderer(Worker& worker);
+    void shutdown_renderer(Worker& worker);
+    bool send_render(Worker& worker, const RenderJob& job, size_t frame_offset, size_t frame_bytes,
+                     RenderCompletion& completion);
+    bool read_trace(Worker& worker, uint32_t payload_len);
+    void send_cancel(Worker& worker, uint32_t job_id);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::function<void()> completion_notifier;
+
+    // Job and completion queues, guarded by mutex
+    std::mutex mutex;
+    std::condition_variable job_ready;
+    std::condition_variable job_done;
+    std::deque<RenderJob> jobs;
+    std::vector<RenderCompletion> completions;
+    std::unordered_set<uint32_t> cancelled;
+    std::unordered_map<int, const Worker*> tab_worker; // renderer holding each tab's last frame
+    uint32_t next_job_id = 1;
+    bool stopping = false;
 };
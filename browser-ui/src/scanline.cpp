@@ -0,0 +1,167 @@
+#include "scanline.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Anti-aliased corners are sampled on a grid this fine per pixel
+constexpr int CORNER_SAMPLES = 16;
+
+// The chrome uses a handful of radii; anything past this is dropped wholesale
+constexpr size_t MAX_CACHED_CORNERS = 64;
+
+// Append a span, extending the previous one when they touch and match
+void push_span(std::vector<CoverageSpan>& spans, int x, int length, uint8_t coverage) {
+    if (length <= 0 || coverage == 0) {
+        return;
+    }
+    if (!spans.empty()) {
+        CoverageSpan& last = spans.back();
+        if (last.coverage == coverage && last.x + last.length == x) {
+            last.length += length;
+            return;
+        }
+    }
+    spans.push_back(CoverageSpan{x, length, coverage});
+}
+
+// Coverage of the top-left quarter of a circle, radius x radius, row-major
+std::vector<uint8_t> corner_mask(int radius, bool antialias) {
+    std::vector<uint8_t> mask(static_cast<size_t>(radius) * radius);
+
+    // Circle centred on the inner corner of the radius x radius block
+    const float r2 = static_cast<float>(radius) * radius;
+    const int samples = antialias ? CORNER_SAMPLES : 1;
+    for (int i = 0; i < radius; ++i) {
+        for (int j = 0; j < radius; ++j) {
+            int inside = 0;
+            for (int sy = 0; sy < samples; ++sy) {
+                const float dy = radius - (i + (sy + 0.5f) / samples);
+                for (int sx = 0; sx < samples; ++sx) {
+                    const float dx = radius - (j + (sx + 0.5f) / samples);
+                    inside += dx * dx + dy * dy <= r2;
+                }
+            }
+            mask[static_cast<size_t>(i) * radius + j] =
+                static_cast<uint8_t>((inside * 255 + samples * samples / 2) / (samples * samples));
+        }
+    }
+    return mask;
+}
+
+std::shared_ptr<const CornerSpans> build_corner_spans(int radius, int stroke, bool antialias) {
+    // A border is the outer shape minus a concentric inner one inset by
+    // the stroke, so it keeps its width round the bend
+    const std::vector<uint8_t> outer = corner_mask(radius, antialias);
+    const int inner_radius = std::max(0, radius - stroke);
+    const std::vector<uint8_t> inner = stroke > 0 ? corner_mask(inner_radius, antialias) : std::vector<uint8_t>();
+
+    auto outer_at = [&](int i, int j) -> int {
+        return i < radius && j < radius ? outer[static_cast<size_t>(i) * radius + j] : 255;
+    };
+    auto inner_at = [&](int i, int j) -> int {
+        if (stroke == 0) {
+            return 0;
+        }
+        i -= stroke;
+        j -= stroke;
+        if (i < 0 || j < 0) {
+            return 0;
+        }
+        return i < inner_radius && j < inner_radius ? inner[static_cast<size_t>(i) * inner_radius + j] : 255;
+    };
+
+    auto corner = std::make_shared<CornerSpans>();
+    corner->window = std::max(radius, stroke);
+    for (int i = 0; i <= corner->window; ++i) {
+        corner->row_start.push_back(corner->spans.size());
+        for (int j = 0; j < corner->window; ++j) {
+            push_span(corner->spans, j, 1, static_cast<uint8_t>(std::max(0, outer_at(i, j) - inner_at(i, j))));
+        }
+        corner->middle.push_back(static_cast<uint8_t>(255 - inner_at(i, corner->window)));
+    }
+    corner->row_start.push_back(corner->spans.size());
+    return corner;
+}
+
+} // namespace
+
+std::shared_ptr<const CornerSpans> CornerCache::get(int radius, int stroke, bool antialias) {
+    const uint64_t key = (static_cast<uint64_t>(radius) << 32) | (static_cast<uint64_t>(stroke) << 1) | antialias;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = corners.find(key);
+    if (it != corners.end()) {
+        return it->second;
+    }
+
+    if (corners.size() >= MAX_CACHED_CORNERS) {
+        corners.clear(); // scans in flight keep theirs through the shared_ptr
+    }
+    auto corner = build_corner_spans(radius, stroke, antialias);
+    corners.emplace(key, corner);
+    return corner;
+}
+
+RoundedRectScan::RoundedRectScan(CornerCache& corners, int x0, int y0, int x1, int y1, float radius,
+                                 float stroke_width, bool antialias)
+    : x0(x0), y0(y0), x1(x1), y1(y1) {
+    const int w = x1 - x0;
+    const int h = y1 - y0;
+    if (w <= 0 || h <= 0) {
+        this->y1 = y0; // no rows
+        return;
+    }
+
+    const int r = std::clamp(static_cast<int>(std::lround(radius)), 0, std::min(w, h) / 2);
+    int stroke = 0;
+    if (stroke_width > 0) {
+        stroke = std::max(1, static_cast<int>(std::lround(stroke_width)));
+        if (2 * stroke >= std::min(w, h)) {
+            stroke = 0; // the border covers everything
+        }
+    }
+    ends = corners.get(r, stroke, antialias);
+}
+
+LineScan::LineScan(float x1, float y1, float x2, float y2, float width, bool antialias)
+    : ax(x1), ay(y1), bx(x2), by(y2), half_width(std::max(width, 1.0f) / 2), antialias(antialias) {
+    const float reach = half_width + 1;
+    row_top = static_cast<int>(std::floor(std::min(ay, by) - reach));
+    row_bottom = static_cast<int>(std::ceil(std::max(ay, by) + reach));
+}
+
+void LineScan::columns(int y, int& first, int& last) const {
+    // The line's bounding box, narrowed to where the row's centre crosses
+    // the band around the line
+    const float dx = bx - ax;
+    const float dy = by - ay;
+    const float cy = y + 0.5f;
+    const float reach = half_width + 1;
+    float left = std::min(ax, bx) - reach;
+    float right = std::max(ax, bx) + reach;
+    if (dy != 0) {
+        const float cross = ax + dx * (cy - ay) / dy;
+        const float half_span = reach * std::hypot(dx, dy) / std::fabs(dy);
+        left = std::max(left, cross - half_span);
+        right = std::min(right, cross + half_span);
+    }
+    first = static_cast<int>(std::floor(left));
+    last = static_cast<int>(std::ceil(right));
+}
+
+uint8_t LineScan::coverage_at(int x, int y) const {
+    // Distance from the pixel centre to the segment
+    const float dx = bx - ax;
+    const float dy = by - ay;
+    const float length2 = dx * dx + dy * dy;
+    const float px = x + 0.5f;
+    const float py = y + 0.5f;
+    const float t = length2 > 0 ? std::clamp(((px - ax) * dx + (py - ay) * dy) / length2, 0.0f, 1.0f) : 0.0f;
+    const float d = std::hypot(px - (ax + t * dx), py - (ay + t * dy));
+
+    if (antialias) {
+        return static_cast<uint8_t>(std::lround(std::clamp(half_width + 0.5f - d, 0.0f, 1.0f) * 255));
+    }
+    return d <= half_width ? 255 : 0;
+}
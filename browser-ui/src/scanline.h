@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// A run of pixels on one row that share a coverage value (255 = fully
+// covered). Shapes hand these out one row at a time to an emit(x, length,
+// coverage) callback, so filling them is one span write each and only
+// the anti-aliased edge pixels come out as short partial-coverage runs.
+struct CoverageSpan {
+    int x;
+    int length;
+    uint8_t coverage;
+};
+
+// The left end of every row of a rounded rect with one radius and stroke
+// width, by distance from the nearer of its top and bottom edges. Rows
+// further in than `window` all look like the last one; the right end is
+// the mirror image, and between the ends coverage is constant per row.
+struct CornerSpans {
+    int window = 0;
+    std::vector<CoverageSpan> spans; // x relative to the left edge
+    std::vector<size_t> row_start;   // window + 2 offsets into spans
+    std::vector<uint8_t> middle;     // window + 1 coverages
+};
+
+// CornerSpans by radius and stroke width, built on first use. Safe to use
+// from several threads at once.
+class CornerCache {
+public:
+    // stroke 0 means filled; both in whole pixels
+    std::shared_ptr<const CornerSpans> get(int radius, int stroke, bool antialias);
+
+private:
+    std::mutex mutex;
+    std::unordered_map<uint64_t, std::shared_ptr<const CornerSpans>> corners;
+};
+
+// A rounded rectangle over pixels [x0, x1) x [y0, y1), filled when
+// stroke_width <= 0 and otherwise just a border that wide. Radius and
+// stroke width are rounded to whole pixels.
+class RoundedRectScan {
+public:
+    RoundedRectScan(CornerCache& corners, int x0, int y0, int x1, int y1, float radius, float stroke_width,
+                    bool antialias);
+
+    int top() const { return y0; }
+    int bottom() const { return y1; }
+
+    // Emit the spans of row y, left to right
+    template <typename Emit>
+    void row(int y, Emit&& emit) const {
+        if (y < y0 || y >= y1) {
+            return;
+        }
+        const int window = ends->window;
+        const int i = std::min(std::min(y - y0, y1 - 1 - y), window);
+        const CoverageSpan* first = &ends->spans[ends->row_start[i]];
+        const CoverageSpan* last = first + (ends->row_start[i + 1] - ends->row_start[i]);
+        for (const CoverageSpan* s = first; s != last; ++s) {
+            emit(x0 + s->x, s->length, s->coverage);
+        }
+        if (ends->middle[i] && x1 - x0 > 2 * window) {
+            emit(x0 + window, x1 - x0 - 2 * window, ends->middle[i]);
+        }
+        for (const CoverageSpan* s = last; s != first;) {
+            --s;
+            emit(x1 - s->x - s->length, s->length, s->coverage);
+        }
+    }
+
+private:
+    int x0, y0, x1, y1;
+    std::shared_ptr<const CornerSpans> ends;
+};
+
+// A straight line of the given width with round caps
+class LineScan {
+public:
+    LineScan(float x1, float y1, float x2, float y2, float width, bool antialias);
+
+    int top() const { return row_top; }
+    int bottom() const { return row_bottom; }
+
+    // Emit the spans of row y, left to right; equal neighbours are merged
+    template <typename Emit>
+    void row(int y, Emit&& emit) const {
+        int first, last;
+        columns(y, first, last);
+        CoverageSpan open{first, 0, 0};
+        for (int x = first; x <= last; ++x) {
+            const uint8_t coverage = coverage_at(x, y);
+            if (coverage == open.coverage && open.x + open.length == x) {
+                ++open.length;
+                continue;
+            }
+            if (open.coverage) {
+                emit(open.x, open.length, open.coverage);
+            }
+            open = CoverageSpan{x, 1, coverage};
+        }
+        if (open.coverage) {
+            emit(open.x, open.length, open.coverage);
+        }
+    }
+
+private:
+    // Columns row y can touch, inclusive
+    void columns(int y, int& first, int& last) const;
+    uint8_t coverage_at(int x, int y) const;
+
+    float ax, ay, bx, by;
+    float half_width;
+    bool antialias;
+    int row_top, row_bottom;
+};
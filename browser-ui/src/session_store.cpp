@@ -0,0 +1,530 @@
+#include "session_store.h"
+#include "trace.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// File layout, all integers in host byte order:
+//   "SQU1DSES" u32 version, then records of u32 type, u32 payload length
+//   TAB     u32 id, str url, str title, i32 history index, u32 count,
+//           count * str (history urls), u32 frame length, frame
+//   CLOSE   u32 id
+//   WINDOW  u32 active tab id
+// A str is a u32 length and its bytes. A frame is u32 width, u32 height,
+// u32 count, count * u64 band offsets, then the compressed bytes.
+const char MAGIC[8] = {'S', 'Q', 'U', '1', 'D', 'S', 'E', 'S'};
+constexpr uint32_t VERSION = 2;
+constexpr size_t HEADER_BYTES = sizeof(MAGIC) + 4;
+constexpr size_t RECORD_HEADER_BYTES = 8;
+
+enum RecordType : uint32_t {
+    RECORD_TAB = 1,
+    RECORD_CLOSE = 2,
+    RECORD_WINDOW = 3,
+};
+
+// Rewrite the file once it is this much bigger than a fresh one would be
+constexpr uint64_t REWRITE_SLACK = uint64_t{1} << 20;
+
+bool pwrite_all(int fd, const uint8_t* data, size_t len, uint64_t offset) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd, data, len, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+bool pread_all(int fd, uint8_t* data, size_t len, uint64_t offset) {
+    while (len > 0) {
+        ssize_t n = pread(fd, data, len, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+void put_u32(std::vector<uint8_t>& out, uint32_t value) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(value));
+}
+
+void put_u64(std::vector<uint8_t>& out, uint64_t value) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(value));
+}
+
+void put_string(std::vector<uint8_t>& out, const std::string& text) {
+    put_u32(out, static_cast<uint32_t>(text.size()));
+    out.insert(out.end(), text.begin(), text.end());
+}
+
+void put_frame(std::vector<uint8_t>& out, const CompressedPixels& frame) {
+    put_u32(out, static_cast<uint32_t>(frame.width));
+    put_u32(out, static_cast<uint32_t>(frame.height));
+    put_u32(out, static_cast<uint32_t>(frame.band_offsets.size()));
+    for (size_t offset : frame.band_offsets) {
+        put_u64(out, offset);
+    }
+    out.insert(out.end(), frame.data.begin(), frame.data.end());
+}
+
+// A TAB record up to its frame length
+void put_tab_details(std::vector<uint8_t>& out, int id, const std::string& url, const std::string& title,
+                     const std::vector<std::string>& history, int history_index) {
+    put_u32(out, static_cast<uint32_t>(id));
+    put_string(out, url);
+    put_string(out, title);
+    put_u32(out, static_cast<uint32_t>(history_index));
+    put_u32(out, static_cast<uint32_t>(history.size()));
+    for (const auto& entry : history) {
+        put_string(out, entry);
+    }
+}
+
+// Start a record; end_record() fills in its length
+size_t begin_record(std::vector<uint8_t>& out, RecordType type) {
+    put_u32(out, type);
+    const size_t start = out.size();
+    put_u32(out, 0);
+    return start;
+}
+
+void end_record(std::vector<uint8_t>& out, size_t start) {
+    const uint32_t length = static_cast<uint32_t>(out.size() - start - 4);
+    std::memcpy(&out[start], &length, sizeof(length));
+}
+
+// Bounds-checked reads from the mapped file
+struct Reader {
+    const uint8_t* pos;
+    const uint8_t* end;
+
+    bool bytes(size_t count, const uint8_t*& out) {
+        if (static_cast<size_t>(end - pos) < count) {
+            return false;
+        }
+        out = pos;
+        pos += count;
+        return true;
+    }
+
+    bool u32(uint32_t& value) {
+        const uint8_t* data;
+        if (!bytes(sizeof(value), data)) {
+            return false;
+        }
+        std::memcpy(&value, data, sizeof(value));
+        return true;
+    }
+
+    bool u64(uint64_t& value) {
+        const uint8_t* data;
+        if (!bytes(sizeof(value), data)) {
+            return false;
+        }
+        std::memcpy(&value, data, sizeof(value));
+        return true;
+    }
+
+    bool string(std::string& text) {
+        uint32_t length;
+        const uint8_t* data;
+        if (!u32(length) || !bytes(length, data)) {
+            return false;
+        }
+        text.assign(reinterpret_cast<const char*>(data), length);
+        return true;
+    }
+};
+
+} // namespace
+
+bool SavedFrame::load(CompressedPixels& out) const {
+    Reader in{data, data + size};
+    uint32_t width, height, count;
+    if (empty() || !in.u32(width) || !in.u32(height) || !in.u32(count) || width == 0 || height == 0 ||
+        count == 0 || count > static_cast<size_t>(in.end - in.pos) / sizeof(uint64_t)) {
+        return false;
+    }
+    CompressedPixels frame;
+    frame.width = static_cast<int>(width);
+    frame.height = static_cast<int>(height);
+    frame.band_offsets.resize(count);
+    for (auto& offset : frame.band_offsets) {
+        uint64_t value;
+        in.u64(value);
+        offset = static_cast<size_t>(value);
+    }
+    if (frame.band_offsets.back() != static_cast<size_t>(in.end - in.pos)) {
+        return false;
+    }
+    frame.data.assign(in.pos, in.end);
+    out = std::move(frame);
+    return true;
+}
+
+bool SessionStore::load(const std::string& path, SavedSession& session) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            std::cerr << "Cannot open session " << path << ": " << std::strerror(errno) << std::endl;
+        }
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) < 0 || static_cast<size_t>(info.st_size) < HEADER_BYTES) {
+        close(fd);
+        return false;
+    }
+    const size_t size = static_cast<size_t>(info.st_size);
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        std::cerr << "Cannot map session " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    std::shared_ptr<const uint8_t> file(static_cast<const uint8_t*>(mapped),
+                                        [size](const uint8_t* data) { munmap(const_cast<uint8_t*>(data), size); });
+
+    Reader in{file.get(), file.get() + size};
+    const uint8_t* magic;
+    uint32_t version;
+    if (!in.bytes(sizeof(MAGIC), magic) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || !in.u32(version) ||
+        version != VERSION) {
+        std::cerr << "Not a session file: " << path << std::endl;
+        return false;
+    }
+
+    // Replay the log; a record cut short by a crash ends it
+    std::vector<std::pair<uint32_t, SavedTab>> tabs;
+    uint32_t active_id = 0;
+    SavedSession saved;
+    while (in.pos < in.end) {
+        uint32_t type, length;
+        const uint8_t* payload;
+        if (!in.u32(type) || !in.u32(length) || !in.bytes(length, payload)) {
+            break;
+        }
+        Reader record{payload, payload + length};
+        uint32_t id;
+        if (type == RECORD_TAB) {
+            SavedTab tab;
+            uint32_t history_index, count, frame_size;
+            const uint8_t* frame;
+            bool ok = record.u32(id) && record.string(tab.url) && record.string(tab.title) &&
+                      record.u32(history_index) && record.u32(count);
+            tab.history.resize(ok ? std::min<size_t>(count, length) : 0);
+            for (auto& url : tab.history) {
+                ok = ok && record.string(url);
+            }
+            if (!ok || !record.u32(frame_size) || !record.bytes(frame_size, frame)) {
+                break;
+            }
+            auto it = std::find_if(tabs.begin(), tabs.end(),
+                                   [id](const std::pair<uint32_t, SavedTab>& t) { return t.first == id; });
+            if (it == tabs.end()) {
+                it = tabs.insert(tabs.end(), {id, SavedTab()});
+            }
+            it->second.url = std::move(tab.url);
+            it->second.title = std::move(tab.title);
+            it->second.history = std::move(tab.history);
+            it->second.history_index =
+                std::clamp(static_cast<int>(history_index), -1, static_cast<int>(it->second.history.size()) - 1);
+            if (frame_size > 0) {
+                it->second.frame = SavedFrame{file, frame, frame_size};
+            }
+        } else if (type == RECORD_CLOSE) {
+            if (!record.u32(id)) {
+                break;
+            }
+            tabs.erase(std::remove_if(tabs.begin(), tabs.end(),
+                                      [id](const std::pair<uint32_t, SavedTab>& t) { return t.first == id; }),
+                       tabs.end());
+        } else if (type == RECORD_WINDOW) {
+            if (!record.u32(active_id)) {
+                break;
+            }
+        }
+        // Unknown record types are skipped
+    }
+
+    for (auto& tab : tabs) {
+        if (tab.first == active_id) {
+            saved.active_index = static_cast<int>(saved.tabs.size());
+        }
+        saved.tabs.push_back(std::move(tab.second));
+    }
+    if (saved.tabs.empty()) {
+        return false;
+    }
+    session = std::move(saved);
+    return true;
+}
+
+SessionStore::SessionStore(const std::string& path)
+    : path(path), fd(-1), file_size(0), active_tab_id(0), thread(&SessionStore::writer_loop, this) {}
+
+SessionStore::~SessionStore() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    thread.join();
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+void SessionStore::save_tab(int tab_id, const std::string& url, const std::string& title,
+                            const std::vector<std::string>& history, int history_index) {
+    TabUpdate update;
+    update.id = tab_id;
+    update.has_details = true;
+    update.url = url;
+    update.title = title;
+    update.history = history;
+    update.history_index = history_index;
+    queue_update(std::move(update));
+}
+
+void SessionStore::save_frame(int tab_id, PixelBufferRef frame) {
+    TabUpdate update;
+    update.id = tab_id;
+    update.frame = std::move(frame);
+    queue_update(std::move(update));
+}
+
+void SessionStore::save_frame(int tab_id, CompressedPixels frame) {
+    TabUpdate update;
+    update.id = tab_id;
+    update.compressed = std::move(frame);
+    queue_update(std::move(update));
+}
+
+void SessionStore::save_frame(int tab_id, SavedFrame frame) {
+    TabUpdate update;
+    update.id = tab_id;
+    update.saved = std::move(frame);
+    queue_update(std::move(update));
+}
+
+void SessionStore::close_tab(int tab_id) {
+    TabUpdate update;
+    update.id = tab_id;
+    update.closed = true;
+    queue_update(std::move(update));
+}
+
+void SessionStore::save_window(int active_tab_id) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending_active_tab_id = active_tab_id;
+        window_changed = true;
+    }
+    work_ready.notify_one();
+}
+
+void SessionStore::queue_update(TabUpdate update) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // Only the latest details and frame of a tab are written, in the
+        // order the tabs first appeared
+        auto queued = std::find_if(pending.begin(), pending.end(),
+                                   [&](const TabUpdate& u) { return u.id == update.id && !u.closed; });
+        if (queued == pending.end() || update.closed) {
+            if (queued != pending.end()) {
+                pending.erase(queued);
+            }
+            pending.push_back(std::move(update));
+        } else {
+            if (update.has_details) {
+                queued->has_details = true;
+                queued->url = std::move(update.url);
+                queued->title = std::move(update.title);
+                queued->history = std::move(update.history);
+                queued->history_index = update.history_index;
+            }
+            if (update.frame || !update.compressed.empty() || !update.saved.empty()) {
+                queued->frame = std::move(update.frame);
+                queued->compressed = std::move(update.compressed);
+                queued->saved = std::move(update.saved);
+            }
+        }
+    }
+    work_ready.notify_one();
+}
+
+void SessionStore::writer_loop() {
+    Trace::set_thread_name("session");
+    std::vector<TabUpdate> updates;
+    int latest_active_tab_id = 0;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        work_ready.wait(lock, [this] { return stopping || !pending.empty() || window_changed; });
+        if (pending.empty() && !window_changed) {
+            return; // stopping, and all written
+        }
+        updates.clear();
+        updates.swap(pending);
+        const bool with_window = window_changed;
+        if (with_window) {
+            latest_active_tab_id = pending_active_tab_id;
+            window_changed = false;
+        }
+        lock.unlock();
+
+        {
+            TRACE_SCOPE("save_session");
+            write_updates(updates, with_window ? &latest_active_tab_id : nullptr);
+        }
+        updates.clear(); // let go of the frames before waiting
+
+        lock.lock();
+    }
+}
+
+bool SessionStore::write_updates(std::vector<TabUpdate>& updates, const int* changed_active_tab_id) {
+    if (fd < 0 && !rewrite()) {
+        return false;
+    }
+
+    // One write per batch: the records, each frame located as it is placed
+    std::vector<uint8_t> out;
+    for (auto& update : updates) {
+        auto record = std::find_if(records.begin(), records.end(),
+                                   [&](const TabRecord& r) { return r.id == update.id; });
+        if (update.closed) {
+            if (record == records.end()) {
+                continue;
+            }
+            records.erase(record);
+            const size_t start = begin_record(out, RECORD_CLOSE);
+            put_u32(out, static_cast<uint32_t>(update.id));
+            end_record(out, start);
+            continue;
+        }
+
+        if (update.frame) {
+            const PixelBuffer& frame = *update.frame;
+            update.compressed = compress_pixels(frame.data(), frame.get_width(), frame.get_height(),
+                                                frame.get_stride());
+            update.frame.reset();
+        }
+        if (record == records.end()) {
+            record = records.insert(records.end(), TabRecord{update.id, "", "", {}, -1, 0, 0});
+        }
+        if (update.has_details) {
+            record->url = std::move(update.url);
+            record->title = std::move(update.title);
+            record->history = std::move(update.history);
+            record->history_index = update.history_index;
+        }
+
+        const size_t start = begin_record(out, RECORD_TAB);
+        put_tab_details(out, record->id, record->url, record->title, record->history, record->history_index);
+        const size_t frame_length = out.size();
+        put_u32(out, 0);
+        const size_t frame_start = out.size();
+        if (!update.compressed.empty()) {
+            put_frame(out, update.compressed);
+        } else if (!update.saved.empty()) {
+            out.insert(out.end(), update.saved.data, update.saved.data + update.saved.size);
+        }
+        const uint32_t frame_size = static_cast<uint32_t>(out.size() - frame_start);
+        std::memcpy(&out[frame_length], &frame_size, sizeof(frame_size));
+        end_record(out, start);
+        if (frame_size > 0) {
+            record->frame_offset = file_size + frame_start;
+            record->frame_size = frame_size;
+        }
+    }
+    if (changed_active_tab_id) {
+        active_tab_id = *changed_active_tab_id;
+        const size_t start = begin_record(out, RECORD_WINDOW);
+        put_u32(out, static_cast<uint32_t>(active_tab_id));
+        end_record(out, start);
+    }
+
+    if (!pwrite_all(fd, out.data(), out.size(), file_size)) {
+        std::cerr << "Cannot write session " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    file_size += out.size();
+    fdatasync(fd);
+
+    // Most of the file is superseded records once it is twice what a
+    // fresh one would take
+    uint64_t live_size = HEADER_BYTES + RECORD_HEADER_BYTES + 4;
+    for (const auto& record : records) {
+        live_size += RECORD_HEADER_BYTES + 24 + record.url.size() + record.title.size() + record.frame_size;
+        for (const auto& url : record.history) {
+            live_size += 4 + url.size();
+        }
+    }
+    if (file_size > 2 * live_size + REWRITE_SLACK) {
+        return rewrite();
+    }
+    return true;
+}
+
+bool SessionStore::rewrite() {
+    // Write the live records to a new file and move it over the old one, so
+    // a crash leaves one or the other whole
+    const std::string temp_path = path + ".tmp";
+    int temp = open(temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (temp < 0) {
+        std::cerr << "Cannot write session " << temp_path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    std::vector<uint8_t> out(MAGIC, MAGIC + sizeof(MAGIC));
+    put_u32(out, VERSION);
+    std::vector<uint64_t> frame_offsets;
+    bool ok = true;
+    for (const auto& record : records) {
+        const size_t start = begin_record(out, RECORD_TAB);
+        put_tab_details(out, record.id, record.url, record.title, record.history, record.history_index);
+        put_u32(out, static_cast<uint32_t>(record.frame_size));
+        frame_offsets.push_back(out.size());
+        out.resize(out.size() + record.frame_size);
+        ok = ok && pread_all(fd, out.data() + frame_offsets.back(), record.frame_size, record.frame_offset);
+        end_record(out, start);
+    }
+    const size_t start = begin_record(out, RECORD_WINDOW);
+    put_u32(out, static_cast<uint32_t>(active_tab_id));
+    end_record(out, start);
+
+    if (!ok || !pwrite_all(temp, out.data(), out.size(), 0) || fdatasync(temp) < 0 ||
+        rename(temp_path.c_str(), path.c_str()) < 0) {
+        std::cerr << "Cannot write session " << path << ": " << std::strerror(errno) << std::endl;
+        close(temp);
+        unlink(temp_path.c_str());
+        return false;
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    fd = temp;
+    file_size = out.size();
+    for (size_t i = 0; i < records.size(); ++i) {
+        records[i].frame_offset = frame_offsets[i];
+    }
+    return true;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "pixel_buffer.h"
+#include "pixel_codec.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A tab's last frame as stored in a session file: compressed, and still in
+// the file's mapping until load() copies it out
+struct SavedFrame {
+    std::shared_ptr<const uint8_t> file; // keeps the mapping alive
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    bool empty() const { return size == 0; }
+    // False if the stored frame is malformed
+    bool load(CompressedPixels& out) const;
+};
+
+struct SavedTab {
+    std::string url;
+    std::string title;
+    std::vector<std::string> history; // urls of the tab's history entries
+    int history_index = -1;
+    SavedFrame frame; // empty if the tab never had one
+};
+
+struct SavedSession {
+    std::vector<SavedTab> tabs; // in tab strip order
+    int active_index = 0;
+};
+
+// The browser session (tabs, their last frames, history) kept in a file so
+// it survives a restart. The file is a log of records appended as things
+// change: the latest record of a tab wins, and a record torn by a crash
+// ends the log. It is rewritten from scratch once mostly stale.
+//
+// Saves are queued and written by a thread of the store's own, which also
+// compresses the frames, so the UI thread never waits on the disk.
+class SessionStore {
+public:
+    // Read the session in path. The file is mapped, not read: frames are
+    // only paged in when their tab loads them. False if there is none or
+    // it cannot be read.
+    static bool load(const std::string& path, SavedSession& session);
+
+    // Start writing to path. The first save replaces whatever it held.
+    explicit SessionStore(const std::string& path);
+    ~SessionStore(); // writes everything still queued
+
+    SessionStore(const SessionStore&) = delete;
+    SessionStore& operator=(const SessionStore&) = delete;
+
+    // Record a tab's url, title and history, appending the tab if it is new
+    void save_tab(int tab_id, const std::string& url, const std::string& title,
+                  const std::vector<std::string>& history, int history_index);
+    // Replace a tab's saved frame, from whichever source it is in
+    void save_frame(int tab_id, PixelBufferRef frame);
+    void save_frame(int tab_id, CompressedPixels frame);
+    void save_frame(int tab_id, SavedFrame frame);
+    void close_tab(int tab_id);
+    void save_window(int active_tab_id);
+
+private:
+    struct TabUpdate {
+        int id = 0;
+        bool closed = false;
+        bool has_details = false;
+        std::string url;
+        std::string title;
+        std::vector<std::string> history;
+        int history_index = -1;
+        // At most one of these is set
+        PixelBufferRef frame;
+        CompressedPixels compressed;
+        SavedFrame saved;
+    };
+
+    struct TabRecord {
+        int id;
+        std::string url;
+        std::string title;
+        std::vector<std::string> history;
+        int history_index;
+        uint64_t frame_offset; // of the frame's bytes in the file; 0 without one
+        uint64_t frame_size;
+    };
+
+    void queue_update(TabUpdate update);
+    void writer_loop();
+    bool write_updates(std::vector<TabUpdate>& updates, const int* active_tab_id);
+    bool rewrite();
+
+    const std::string path;
+
+    // Writer thread only
+    int fd;
+    uint64_t file_size;
+    std::vector<TabRecord> records;
+    int active_tab_id;
+
+    // Guarded by mutex
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    std::vector<TabUpdate> pending;
+    int pending_active_tab_id = 0;
+    bool window_changed = false;
+    bool stopping = false;
+
+    std::thread thread;
+};
@@ -1,24 +1,208 @@
 #include "tab_manager.h"
+#include "trace.h"
+#include <cstdlib>
+#include <cstring>
 
 Tab::Tab(const std::string& url, const std::string& title)
-    : url(url), title(title), is_active(false) {}
+    : id(0), url(url), title(title), is_active(false),
+      content_width(0), content_height(0), content_job(0), pending_render(0), content_version(0),
+      content_is_current(false), content_discarded(false), last_used(0), history_index(-1), patched_tag(0),
+      patched_from(0) {}
 
 void Tab::set_title(const std::string& title) {
     this->title = title;
 }
 
-void Tab::set_content(const std::vector<uint8_t>& content) {
-    rendered_content = content;
+void Tab::set_content(PixelBufferRef content) {
+    rendered_content = std::move(content);
+    content_width = rendered_content ? rendered_content->get_width() : 0;
+    content_height = rendered_content ? rendered_content->get_height() : 0;
+    compressed_content = CompressedPixels();
+    content_discarded = false;
+    content_is_current = true;
+    ++content_version;
 }
 
-TabManager::TabManager() : active_tab_index(0) {
+void Tab::set_compressed_content(CompressedPixels content) {
+    rendered_content.reset();
+    patch_buffers.clear();
+    compressed_content = std::move(content);
+    content_width = compressed_content.width;
+    content_height = compressed_content.height;
+    content_discarded = false;
+    content_is_current = true;
+    ++content_version;
+}
+
+namespace {
+
+void copy_rects(const PixelBuffer& from, PixelBuffer& to, const std::vector<PixelRect>& rects) {
+    const size_t stride = to.get_stride();
+    for (const auto& rect : rects) {
+        const size_t row_bytes = static_cast<size_t>(rect.width) * 4;
+        for (int y = rect.y; y < rect.y + rect.height; ++y) {
+            std::memcpy(to.mutable_data() + y * stride + rect.x * 4, from.row(y) + rect.x * 4, row_bytes);
+        }
+    }
+}
+
+} // namespace
+
+bool Tab::apply_damage(const PixelBuffer& frame, const std::vector<PixelRect>& rects) {
+    if (!restore_content(nullptr) || !rendered_content || frame.get_width() != content_width ||
+        frame.get_height() != content_height) {
+        return false;
+    }
+    for (const auto& rect : rects) {
+        if (rect.x < 0 || rect.y < 0 || rect.x + rect.width > content_width ||
+            rect.y + rect.height > content_height) {
+            return false;
+        }
+    }
+
+    // The buffer the content was patched from last time is likely back
+    // in the pool by now; it only misses that patch's rects
+    const bool patched_last = patched_content.lock() == rendered_content;
+    bool caught_up = false;
+    std::shared_ptr<PixelBuffer> target = patch_buffers.take(
+        content_width, content_height, rendered_content->get_format(), patched_last ? patched_from : 0, &caught_up);
+    if (!target) {
+        return false;
+    }
+    if (caught_up) {
+        copy_rects(*rendered_content, *target, patched_rects);
+    } else {
+        const size_t row_bytes = static_cast<size_t>(content_width) * 4;
+        for (int y = 0; y < content_height; ++y) {
+            std::memcpy(target->mutable_data() + y * target->get_stride(), rendered_content->row(y), row_bytes);
+        }
+    }
+    copy_rects(frame, *target, rects);
+
+    // Only a frame of the pool's own can come back to it
+    patched_from = patched_last ? patched_tag : 0;
+    patched_rects = rects;
+    rendered_content = patch_buffers.share(std::move(target), &patched_tag);
+    patched_content = rendered_content;
+    content_is_current = true;
+    ++content_version;
+    return true;
+}
+
+void Tab::compress_content(WorkStealingPool* pool) {
+    if (!rendered_content) {
+        return;
+    }
+    CompressedPixels compressed = compress_pixels(rendered_content->data(), content_width, content_height,
+                                                  rendered_content->get_stride(), pool);
+    if (compressed.bytes() >= rendered_content->bytes()) {
+        return; // noise-like frames do not shrink; leave them to be dropped
+    }
+    compressed_content = std::move(compressed);
+    rendered_content.reset(); // the frame's memory goes with its last reference
+    patch_buffers.clear();
+}
+
+bool Tab::restore_content(WorkStealingPool* pool) {
+    if (rendered_content || compressed_content.empty()) {
+        return true;
+    }
+    auto frame = PixelBuffer::allocate(content_width, content_height);
+    if (!frame || !decompress_pixels(compressed_content, frame->mutable_data(), pool)) {
+        discard_content();
+        return false;
+    }
+    rendered_content = std::move(frame);
+    compressed_content = CompressedPixels();
+    return true;
+}
+
+void Tab::discard_content() {
+    rendered_content.reset();
+    patch_buffers.clear();
+    compressed_content = CompressedPixels();
+    content_discarded = true;
+    content_job = 0; // nothing left to diff against: the next render is a whole frame
+}
+
+void Tab::keep_frame_in_history() {
+    if (history_index < 0 || !content_is_current) {
+        return;
+    }
+    HistoryEntry& current = history[history_index];
+    current.title = title;
+    current.frame = rendered_content; // shared, not copied
+    current.compressed = rendered_content ? CompressedPixels() : compressed_content;
+}
+
+void Tab::push_history(const std::string& url) {
+    keep_frame_in_history();
+    history.resize(history_index + 1);
+    history.push_back(HistoryEntry{url, "", nullptr, CompressedPixels()});
+    history_index = static_cast<int>(history.size()) - 1;
+    content_is_current = false; // until the new page's render lands
+    this->url = url;
+    for (int i = 0; i < history_index - CACHED_HISTORY_ENTRIES; ++i) {
+        history[i].drop_frame();
+    }
+}
+
+bool Tab::can_step_history(int delta) const {
+    const int target = history_index + delta;
+    return delta != 0 && target >= 0 && target < static_cast<int>(history.size());
+}
+
+bool Tab::step_history(int delta, WorkStealingPool* pool) {
+    if (!can_step_history(delta)) {
+        return false;
+    }
+    keep_frame_in_history();
+    history_index += delta;
+    content_is_current = false;
+    for (int i = 0; i < static_cast<int>(history.size()); ++i) {
+        if (std::abs(i - history_index) > CACHED_HISTORY_ENTRIES) {
+            history[i].drop_frame();
+        }
+    }
+
+    HistoryEntry& entry = history[history_index];
+    url = entry.url;
+    title = entry.title.empty() ? entry.url : entry.title;
+    if (!entry.is_cached()) {
+        return false;
+    }
+    if (entry.frame) {
+        set_content(std::move(entry.frame));
+    } else {
+        set_compressed_content(std::move(entry.compressed));
+    }
+    entry.drop_frame();
+    content_job = 0; // not what the renderer last sent, so not a base for damage
+    return restore_content(pool);
+}
+
+size_t Tab::history_bytes() const {
+    size_t total = 0;
+    for (const auto& entry : history) {
+        total += entry.bytes();
+    }
+    return total;
+}
+
+TabManager::TabManager()
+    : active_tab_index(0), next_tab_id(1), memory_budget(DEFAULT_MEMORY_BUDGET),
+      resident_tabs(DEFAULT_RESIDENT_TABS), history_budget(DEFAULT_HISTORY_BUDGET), use_clock(0), pool(nullptr) {
     // Create initial tab
     tabs.push_back(std::make_shared<Tab>("https://google.com", "New Tab"));
+    tabs[0]->id = next_tab_id++;
     tabs[0]->is_active = true;
+    tabs[0]->last_used = ++use_clock;
 }
 
 std::shared_ptr<Tab> TabManager::create_tab(const std::string& url) {
     auto tab = std::make_shared<Tab>(url, "Loading...");
+    tab->id = next_tab_id++;
+    tab->last_used = ++use_clock;
     tabs.push_back(tab);
     return tab;
 }
@@ -37,6 +221,9 @@ void TabManager::close_tab(int index) {
     }
     
     tabs.erase(tabs.begin() + index);
+    if (index < active_tab_index) {
+        --active_tab_index; // the active tab moved down one
+    }
     if (active_tab_index >= static_cast<int>(tabs.size()) && !tabs.empty()) {
         active_tab_index = tabs.size() - 1;
     }
@@ -54,6 +241,8 @@ void TabManager::switch_tab(int index) {
     active_tab_index = index;
     if (index >= 0 && index < static_cast<int>(tabs.size())) {
         tabs[index]->is_active = true;
+        tabs[index]->last_used = ++use_clock;
+        tabs[index]->restore_content(pool);
     }
 }
 
@@ -70,3 +259,108 @@ std::shared_ptr<Tab> TabManager::get_tab(int index) const {
     }
     return nullptr;
 }
+
+std::shared_ptr<Tab> TabManager::find_tab(int id) const {
+    for (const auto& tab : tabs) {
+        if (tab->id == id) {
+            return tab;
+        }
+    }
+    return nullptr;
+}
+
+size_t TabManager::content_bytes() const {
+    size_t total = 0;
+    for (const auto& tab : tabs) {
+        total += tab->content_bytes();
+    }
+    return total;
+}
+
+void TabManager::enforce_memory_budget() {
+    enforce_history_budget();
+
+    // Most recently used first
+    by_recency.clear();
+    for (const auto& tab : tabs) {
+        if (!tab->is_active && tab->has_content()) {
+            by_recency.push_back(tab.get());
+        }
+    }
+    std::sort(by_recency.begin(), by_recency.end(),
+              [](const Tab* a, const Tab* b) { return a->last_used > b->last_used; });
+    const size_t keep = std::min(by_recency.size(), static_cast<size_t>(resident_tabs - 1));
+
+    size_t total = content_bytes();
+    bool settled = total <= memory_budget;
+    for (size_t i = keep; i < by_recency.size() && settled; ++i) {
+        settled = !by_recency[i]->is_resident();
+    }
+    if (settled) {
+        return;
+    }
+    TRACE_SCOPE("compress_tabs");
+
+    auto compress = [&](Tab* tab) {
+        if (tab->is_resident()) {
+            const size_t before = tab->content_bytes();
+            tab->compress_content(pool);
+            total = total - before + tab->content_bytes();
+        }
+    };
+    // Past the most recently used tabs frames are only kept compressed.
+    // Over budget the recent ones follow, least recent first, and then
+    // frames are dropped in the same order.
+    for (size_t i = keep; i < by_recency.size(); ++i) {
+        compress(by_recency[i]);
+    }
+    for (size_t i = keep; i-- > 0 && total > memory_budget;) {
+        compress(by_recency[i]);
+    }
+    for (size_t i = by_recency.size(); i-- > 0 && total > memory_budget;) {
+        total -= by_recency[i]->content_bytes();
+        by_recency[i]->discard_content();
+    }
+}
+
+void TabManager::enforce_history_budget() {
+    size_t total = 0;
+    for (const auto& tab : tabs) {
+        for (auto& entry : tab->history) {
+            if (entry.frame) {
+                // Left by a navigation; noise-like frames that do not
+                // shrink are not worth keeping
+                TRACE_SCOPE("compress_history");
+                const PixelBuffer& frame = *entry.frame;
+                CompressedPixels compressed = compress_pixels(frame.data(), frame.get_width(), frame.get_height(),
+                                                              frame.get_stride(), pool);
+                if (compressed.bytes() < frame.bytes()) {
+                    entry.compressed = std::move(compressed);
+                }
+                entry.frame.reset();
+            }
+            total += entry.bytes();
+        }
+    }
+    if (total <= history_budget) {
+        return;
+    }
+
+    by_recency.clear();
+    for (const auto& tab : tabs) {
+        by_recency.push_back(tab.get());
+    }
+    std::sort(by_recency.begin(), by_recency.end(),
+              [](const Tab* a, const Tab* b) { return a->last_used < b->last_used; });
+    for (Tab* tab : by_recency) {
+        auto& history = tab->history;
+        for (int distance = static_cast<int>(history.size()); distance > 0 && total > history_budget; --distance) {
+            for (int i : {tab->history_index - distance, tab->history_index + distance}) {
+                if (i >= 0 && i < static_cast<int>(history.size())) {
+                    total -= history[i].bytes();
+                    history[i].drop_frame();
+                }
+            }
+        }
+    }
+}
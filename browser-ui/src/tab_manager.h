@@ -1,28 +1,135 @@
 #pragma once
 
+#include "ui_types.h"
+#include "pixel_buffer.h"
+#include "pixel_codec.h"
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <memory>
 #include <cstdint>
 
+// One page of a tab's back/forward history. Entries near the current one
+// keep the frame they showed (the back/forward cache), compressed once the
+// frame is out, so going back or forward needs no render.
+struct HistoryEntry {
+    std::string url;
+    std::string title;
+    PixelBufferRef frame;
+    CompressedPixels compressed;
+
+    bool is_cached() const { return frame || !compressed.empty(); }
+    size_t bytes() const { return (frame ? frame->bytes() : 0) + compressed.bytes(); }
+    void drop_frame() {
+        frame.reset();
+        compressed = CompressedPixels();
+    }
+};
+
 class Tab {
 public:
+    // Entries further than this from the current one keep no frame
+    static constexpr int CACHED_HISTORY_ENTRIES = 8;
+
+    int id;
     std::string title;
     std::string url;
     bool is_active;
-    std::vector<uint8_t> rendered_content;
+    PixelBufferRef rendered_content; // ARGB8888, premultiplied; null without a frame
+    int content_width;
+    int content_height;
+    uint32_t content_job;    // RendererBridge job that produced rendered_content
+    uint32_t pending_render; // RendererBridge job id, 0 when idle
+    uint32_t content_version; // bumped whenever the page shown changes
+    // rendered_content is the current history entry's page, not one left
+    // up from before a navigation whose render has not landed (or failed)
+    bool content_is_current;
+
+    // Under memory pressure a background tab's frame is compressed (and
+    // rendered_content released), or dropped altogether so the tab has to be
+    // rendered again before it can be shown
+    CompressedPixels compressed_content;
+    bool content_discarded;
+    uint64_t last_used; // TabManager's use clock when last active
+
+    // history_index is the entry shown; -1 before the first navigation
+    std::vector<HistoryEntry> history;
+    int history_index;
 
     Tab(const std::string& url, const std::string& title = "New Tab");
     void set_title(const std::string& title);
-    void set_content(const std::vector<uint8_t>& content);
+    void set_content(PixelBufferRef content);
+    // A frame kept compressed from the start, e.g. one saved with the session
+    void set_compressed_content(CompressedPixels content);
+    // Copy the damage rects of frame, a frame of the same size, over
+    // rendered_content. The patch goes into a buffer of the tab's own pool,
+    // never into a frame already shared, and the tab moves to it.
+    bool apply_damage(const PixelBuffer& frame, const std::vector<PixelRect>& rects);
+
+    // A frame is kept, uncompressed or not
+    bool has_content() const { return rendered_content || !compressed_content.empty(); }
+    bool is_resident() const { return rendered_content != nullptr; }
+    size_t content_bytes() const {
+        return (rendered_content ? rendered_content->bytes() : 0) + compressed_content.bytes() +
+               patch_buffers.free_bytes();
+    }
+
+    // pool may be null; restore_content() is false (and the frame dropped)
+    // if the compressed data is corrupt
+    void compress_content(WorkStealingPool* pool);
+    bool restore_content(WorkStealingPool* pool);
+    void discard_content();
+
+    // Start a new entry for url, after the current one (entries forward of
+    // it are dropped). The current page's frame goes to its entry.
+    void push_history(const std::string& url);
+    bool can_step_history(int delta) const;
+    // Move delta entries back (negative) or forward, keeping the current
+    // frame in its entry. True if the entry's frame was cached and is now
+    // the content; otherwise the old content stays up until a render.
+    bool step_history(int delta, WorkStealingPool* pool);
+    size_t history_bytes() const;
+    // Give the current entry the frame shown, if it is that entry's
+    void keep_frame_in_history();
+
+private:
+    PixelBufferPool patch_buffers;
+    // The frame the last apply_damage() made (shared from patch_buffers as
+    // patched_tag), the pool share it was patched from (0 if the frame
+    // before was not the pool's) and the rects it changed. While that frame
+    // is still the content, the buffer it came from needs only those rects
+    // to catch up.
+    std::weak_ptr<const PixelBuffer> patched_content;
+    uint64_t patched_tag;
+    uint64_t patched_from;
+    std::vector<PixelRect> patched_rects;
 };
 
 class TabManager {
 private:
     std::vector<std::shared_ptr<Tab>> tabs;
     int active_tab_index;
+    int next_tab_id;
+
+    // Only the resident_tabs most recently used tabs (the active one
+    // included) keep their frames uncompressed. Beyond memory_budget bytes
+    // the recent background tabs are compressed too, least recent first,
+    // and then frames are dropped in the same order.
+    size_t memory_budget;
+    int resident_tabs;
+    // Frames cached in history entries, always compressed, are dropped
+    // beyond history_budget bytes: least recently used tabs first, and
+    // within a tab the entries furthest from the current one
+    size_t history_budget;
+    uint64_t use_clock;
+    WorkStealingPool* pool; // not owned; may be null
+    std::vector<Tab*> by_recency; // scratch for enforce_memory_budget()
 
 public:
+    static constexpr size_t DEFAULT_MEMORY_BUDGET = size_t{512} << 20;
+    static constexpr int DEFAULT_RESIDENT_TABS = 3;
+    static constexpr size_t DEFAULT_HISTORY_BUDGET = size_t{128} << 20;
+
     TabManager();
     
     std::shared_ptr<Tab> create_tab(const std::string& url);
@@ -30,7 +137,20 @@ public:
     void switch_tab(int index);
     std::shared_ptr<Tab> get_active_tab() const;
     std::shared_ptr<Tab> get_tab(int index) const;
+    std::shared_ptr<Tab> find_tab(int id) const;
     int get_tab_count() const { return tabs.size(); }
     int get_active_index() const { return active_tab_index; }
     std::vector<std::shared_ptr<Tab>>& get_tabs() { return tabs; }
+
+    void set_memory_budget(size_t bytes) { memory_budget = bytes; }
+    void set_resident_tabs(int count) { resident_tabs = std::max(1, count); }
+    void set_history_budget(size_t bytes) { history_budget = bytes; }
+    void set_thread_pool(WorkStealingPool* pool) { this->pool = pool; }
+    size_t content_bytes() const;
+    // Compress or drop background and history frames as above; cheap when
+    // nothing needs doing, so it can run after every frame
+    void enforce_memory_budget();
+
+private:
+    void enforce_history_budget();
 };
@@ -0,0 +1,189 @@
+#include "thumbnail_cache.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Average each dst pixel over the block of src pixels it covers. Frames
+// are premultiplied, so plain channel averages are correct.
+void box_downscale(const PixelBuffer& src, PixelBuffer& dst, std::vector<uint32_t>& sums,
+                   std::vector<int>& columns) {
+    const int sw = src.get_width();
+    const int sh = src.get_height();
+    const int dw = dst.get_width();
+    const int dh = dst.get_height();
+
+    // columns[x]..columns[x + 1] are the src columns of dst column x
+    columns.resize(static_cast<size_t>(dw) + 1);
+    for (int x = 0; x <= dw; ++x) {
+        columns[x] = static_cast<int>(static_cast<int64_t>(x) * sw / dw);
+    }
+    sums.resize(static_cast<size_t>(dw) * 4);
+
+    for (int y = 0; y < dh; ++y) {
+        const int y0 = static_cast<int>(static_cast<int64_t>(y) * sh / dh);
+        const int y1 = std::max(y0 + 1, static_cast<int>(static_cast<int64_t>(y + 1) * sh / dh));
+        std::fill(sums.begin(), sums.end(), 0u);
+        for (int sy = y0; sy < y1; ++sy) {
+            const uint8_t* row = src.row(sy);
+            for (int x = 0; x < dw; ++x) {
+                uint32_t* sum = &sums[static_cast<size_t>(x) * 4];
+                const int x1 = std::max(columns[x] + 1, columns[x + 1]);
+                for (const uint8_t* p = row + columns[x] * 4; p < row + x1 * 4; p += 4) {
+                    sum[0] += p[0];
+                    sum[1] += p[1];
+                    sum[2] += p[2];
+                    sum[3] += p[3];
+                }
+            }
+        }
+
+        uint8_t* out = dst.mutable_data() + static_cast<size_t>(y) * dst.get_stride();
+        for (int x = 0; x < dw; ++x) {
+            const uint32_t count =
+                static_cast<uint32_t>(y1 - y0) * static_cast<uint32_t>(std::max(1, columns[x + 1] - columns[x]));
+            for (int c = 0; c < 4; ++c) {
+                out[x * 4 + c] = static_cast<uint8_t>((sums[static_cast<size_t>(x) * 4 + c] + count / 2) / count);
+            }
+        }
+    }
+}
+
+std::shared_ptr<const Thumbnail> make_thumbnail(const PixelBuffer& frame, std::vector<uint32_t>& sums,
+                                                std::vector<int>& columns) {
+    auto thumbnail = std::make_shared<Thumbnail>();
+    const PixelBuffer* source = &frame;
+    int width = std::min(frame.get_width(), ThumbnailCache::THUMBNAIL_WIDTH);
+    int height = std::max(1, static_cast<int>(static_cast<int64_t>(frame.get_height()) * width / frame.get_width()));
+    while (true) {
+        auto level = PixelBuffer::allocate(width, height, frame.get_format());
+        if (!level) {
+            break;
+        }
+        box_downscale(*source, *level, sums, columns);
+        thumbnail->levels.push_back(level);
+        source = level.get();
+        if (width / 2 < ThumbnailCache::MIN_LEVEL_WIDTH || height < 2) {
+            break;
+        }
+        width /= 2;
+        height /= 2;
+    }
+    return thumbnail;
+}
+
+} // namespace
+
+const PixelBufferRef& Thumbnail::level_for(int width) const {
+    for (size_t i = levels.size(); i-- > 0;) {
+        if (levels[i]->get_width() >= width) {
+            return levels[i];
+        }
+    }
+    return levels.front();
+}
+
+ThumbnailCache::ThumbnailCache() : thread(&ThumbnailCache::worker_loop, this) {}
+
+ThumbnailCache::~ThumbnailCache() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    thread.join();
+}
+
+void ThumbnailCache::update(int tab_id, PixelBufferRef frame) {
+    if (!frame || frame->get_width() <= 0 || frame->get_height() <= 0) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto waiting = std::find_if(queue.begin(), queue.end(),
+                                    [tab_id](const std::pair<int, PixelBufferRef>& job) { return job.first == tab_id; });
+        if (waiting != queue.end()) {
+            waiting->second = std::move(frame);
+            return;
+        }
+        queue.emplace_back(tab_id, std::move(frame));
+    }
+    work_ready.notify_one();
+}
+
+void ThumbnailCache::remove(int tab_id) {
+    thumbnails.erase(tab_id);
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.erase(std::remove_if(queue.begin(), queue.end(),
+                               [tab_id](const std::pair<int, PixelBufferRef>& job) { return job.first == tab_id; }),
+                queue.end());
+    finished.erase(std::remove_if(finished.begin(), finished.end(),
+                                  [tab_id](const std::pair<int, std::shared_ptr<const Thumbnail>>& done) {
+                                      return done.first == tab_id;
+                                  }),
+                   finished.end());
+    if (working_on == tab_id) {
+        working_on = -1; // what it is making now is dropped when it lands
+    }
+}
+
+bool ThumbnailCache::collect() {
+    std::vector<std::pair<int, std::shared_ptr<const Thumbnail>>> done;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done.swap(finished);
+    }
+    for (auto& thumbnail : done) {
+        thumbnails[thumbnail.first] = std::move(thumbnail.second);
+    }
+    return !done.empty();
+}
+
+std::shared_ptr<const Thumbnail> ThumbnailCache::get(int tab_id) const {
+    auto it = thumbnails.find(tab_id);
+    return it != thumbnails.end() ? it->second : nullptr;
+}
+
+bool ThumbnailCache::idle() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return queue.empty() && working_on < 0 && finished.empty();
+}
+
+void ThumbnailCache::worker_loop() {
+    Trace::set_thread_name("thumbnails");
+    std::vector<uint32_t> sums;
+    std::vector<int> columns;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        work_ready.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (stopping) {
+            return;
+        }
+        const int tab_id = queue.front().first;
+        PixelBufferRef frame = std::move(queue.front().second);
+        queue.pop_front();
+        working_on = tab_id;
+        lock.unlock();
+
+        std::shared_ptr<const Thumbnail> thumbnail;
+        {
+            TRACE_SCOPE("thumbnail");
+            thumbnail = make_thumbnail(*frame, sums, columns);
+        }
+        frame.reset(); // its buffer may be reused once released
+
+        lock.lock();
+        const bool wanted = working_on == tab_id && !thumbnail->levels.empty();
+        working_on = -1;
+        if (wanted) {
+            finished.emplace_back(tab_id, std::move(thumbnail));
+            if (completion_notifier) {
+                lock.unlock();
+                completion_notifier();
+                lock.lock();
+            }
+        }
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "pixel_buffer.h"
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Box-filtered downscales of a tab's frame for the tab overview, each
+// level half the size of the one before
+struct Thumbnail {
+    std::vector<PixelBufferRef> levels; // levels[0] is the largest
+
+    // The smallest level at least width pixels wide (else the largest), to
+    // be scaled the rest of the way
+    const PixelBufferRef& level_for(int width) const;
+};
+
+// Thumbnails of every tab, made on a thread of their own whenever a tab's
+// frame changes so that the overview only ever draws small, finished
+// images. They are kept apart from the frames and outlive them: a tab that
+// was compressed or dropped to save memory keeps its thumbnail.
+//
+// update() and collect() are for the UI thread; collect() hands over
+// what the thread finished, much like RendererBridge::poll_completions().
+class ThumbnailCache {
+public:
+    static constexpr int THUMBNAIL_WIDTH = 256;
+    static constexpr int MIN_LEVEL_WIDTH = 16;
+
+    ThumbnailCache();
+    ~ThumbnailCache();
+
+    ThumbnailCache(const ThumbnailCache&) = delete;
+    ThumbnailCache& operator=(const ThumbnailCache&) = delete;
+
+    // Queue a thumbnail of frame for tab_id. A frame of the same tab still
+    // waiting is replaced, so a tab that changes often costs one thumbnail
+    // at a time. The frame is only read, and let go once the thumbnail is
+    // made.
+    void update(int tab_id, PixelBufferRef frame);
+    void remove(int tab_id);
+
+    // Take in thumbnails finished since the last call; true if any did.
+    // Never blocks.
+    bool collect();
+
+    // Null until the tab's first thumbnail is collected
+    std::shared_ptr<const Thumbnail> get(int tab_id) const;
+
+    // Nothing queued or being made
+    bool idle() const;
+
+    // Called on the cache's thread whenever a thumbnail is finished, so an
+    // idle UI loop can be woken
+    void set_completion_notifier(std::function<void()> notifier) { completion_notifier = std::move(notifier); }
+
+private:
+    void worker_loop();
+
+    std::unordered_map<int, std::shared_ptr<const Thumbnail>> thumbnails; // UI thread only
+    std::function<void()> completion_notifier;
+
+    // Guarded by mutex
+    mutable std::mutex mutex;
+    std::condition_variable work_ready;
+    std::deque<std::pair<int, PixelBufferRef>> queue;
+    std::vector<std::pair<int, std::shared_ptr<const Thumbnail>>> finished;
+    int working_on = -1; // tab id, or -1
+    bool stopping = false;
+
+    std::thread thread;
+};
@@ -0,0 +1,238 @@
+#include "trace.h"
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <unistd.h>
+
+namespace {
+
+// Events kept per thread; older ones are overwritten
+constexpr size_t RING_EVENTS = 16384;
+
+// Frames the HUD statistics look back over
+constexpr size_t FRAME_WINDOW = 240;
+
+struct Event {
+    const char* name;
+    uint64_t start_ns;
+    uint64_t end_ns;
+};
+
+// Only its owning thread writes a ring; the mutex is for the rare dump
+// and is otherwise uncontended
+struct Ring {
+    std::mutex mutex;
+    std::vector<Event> events;
+    size_t written = 0;
+    int process_id = 0;
+    int thread_id = 0;
+    std::string thread_name;
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<Ring>> rings;
+    std::unordered_map<int, std::shared_ptr<Ring>> external; // by process id
+    std::unordered_set<std::string> names;                   // of external spans
+    int next_thread_id = 1;
+};
+
+Registry& registry() {
+    static Registry* instance = new Registry(); // never destroyed: threads may outlive statics
+    return *instance;
+}
+
+std::shared_ptr<Ring> new_ring(int process_id) {
+    auto ring = std::make_shared<Ring>();
+    ring->events.resize(RING_EVENTS);
+    ring->process_id = process_id;
+    return ring;
+}
+
+Ring& thread_ring() {
+    thread_local std::shared_ptr<Ring> ring;
+    if (!ring) {
+        ring = new_ring(getpid());
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        ring->thread_id = r.next_thread_id++;
+        r.rings.push_back(ring);
+    }
+    return *ring;
+}
+
+void push(Ring& ring, const char* name, uint64_t start_ns, uint64_t end_ns) {
+    std::lock_guard<std::mutex> lock(ring.mutex);
+    ring.events[ring.written % RING_EVENTS] = Event{name, start_ns, end_ns};
+    ++ring.written;
+}
+
+void write_json_string(std::ostream& out, const std::string& s) {
+    out << '"';
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out << escaped;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+// Nanoseconds as the microseconds Chrome traces use
+void write_us(std::ostream& out, uint64_t ns) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%llu.%03u", static_cast<unsigned long long>(ns / 1000),
+                  static_cast<unsigned>(ns % 1000));
+    out << text;
+}
+
+} // namespace
+
+namespace Trace {
+
+uint64_t now_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000u + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+void set_thread_name(const char* name) {
+    if (!ENABLED) {
+        return; // no ring for threads that will never record
+    }
+    Ring& ring = thread_ring();
+    std::lock_guard<std::mutex> lock(ring.mutex);
+    ring.thread_name = name;
+}
+
+void record(const char* name, uint64_t start_ns, uint64_t end_ns) {
+    push(thread_ring(), name, start_ns, end_ns);
+}
+
+void record_external(int process_id, const std::string& name, uint64_t start_ns, uint64_t end_ns) {
+    if (!ENABLED) {
+        return;
+    }
+    std::shared_ptr<Ring> ring;
+    const char* interned;
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        auto& slot = r.external[process_id];
+        if (!slot) {
+            slot = new_ring(process_id);
+            slot->thread_id = 1;
+            slot->thread_name = "renderer";
+            r.rings.push_back(slot);
+        }
+        ring = slot;
+        interned = r.names.insert(name).first->c_str();
+    }
+    push(*ring, interned, start_ns, end_ns);
+}
+
+bool write_chrome_json(const std::string& path) {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Cannot write trace " << path << std::endl;
+        return false;
+    }
+
+    std::vector<std::shared_ptr<Ring>> rings;
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        rings = r.rings;
+    }
+
+    out << "{\"traceEvents\": [\n";
+    bool first = true;
+    auto separator = [&] {
+        out << (first ? "  " : ",\n  ");
+        first = false;
+    };
+
+    const int own_pid = getpid();
+    std::unordered_set<int> named_processes;
+    std::vector<Event> events;
+    for (const auto& ring : rings) {
+        std::string thread_name;
+        {
+            std::lock_guard<std::mutex> lock(ring->mutex);
+            const size_t count = std::min(ring->written, RING_EVENTS);
+            events.clear();
+            for (size_t i = ring->written - count; i < ring->written; ++i) {
+                events.push_back(ring->events[i % RING_EVENTS]);
+            }
+            thread_name = ring->thread_name;
+        }
+
+        if (named_processes.insert(ring->process_id).second) {
+            separator();
+            out << "{\"ph\": \"M\", \"name\": \"process_name\", \"pid\": " << ring->process_id
+                << ", \"args\": {\"name\": \"" << (ring->process_id == own_pid ? "squ1d-browser" : "renderer")
+                << "\"}}";
+        }
+        if (!thread_name.empty()) {
+            separator();
+            out << "{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": " << ring->process_id
+                << ", \"tid\": " << ring->thread_id << ", \"args\": {\"name\": ";
+            write_json_string(out, thread_name);
+            out << "}}";
+        }
+        for (const Event& event : events) {
+            separator();
+            out << "{\"ph\": \"X\", \"name\": ";
+            write_json_string(out, event.name);
+            out << ", \"pid\": " << ring->process_id << ", \"tid\": " << ring->thread_id << ", \"ts\": ";
+            write_us(out, event.start_ns);
+            out << ", \"dur\": ";
+            write_us(out, event.end_ns > event.start_ns ? event.end_ns - event.start_ns : 0);
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
+
+} // namespace Trace
+
+FrameStats::FrameStats() : times(FRAME_WINDOW, 0.0) {
+    sorted.reserve(FRAME_WINDOW);
+}
+
+void FrameStats::add(double frame_ms) {
+    double& slot = times[total % times.size()];
+    if (total >= times.size() && slot > FRAME_BUDGET_MS) {
+        --dropped_frames; // leaving the window
+    }
+    slot = frame_ms;
+    if (frame_ms > FRAME_BUDGET_MS) {
+        ++dropped_frames;
+    }
+    ++total;
+}
+
+double FrameStats::last() const {
+    return total ? times[(total - 1) % times.size()] : 0.0;
+}
+
+double FrameStats::p99() const {
+    if (total == 0) {
+        return 0.0;
+    }
+    sorted.assign(times.begin(), times.begin() + count());
+    const size_t rank = (sorted.size() * 99 + 99) / 100 - 1; // nearest rank
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    return sorted[rank];
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Frame-phase tracing. TRACE_SCOPE("name") times the enclosing scope into
+// a ring buffer owned by the calling thread, so recording never contends;
+// the newest events of every thread can be written out as Chrome trace
+// event JSON (chrome://tracing, Perfetto). Without SQU1D_TRACING defined
+// the macro expands to nothing.
+//
+// Times are CLOCK_MONOTONIC nanoseconds. The renderer stamps its spans
+// with the same clock, so they share the UI's timeline.
+namespace Trace {
+
+#ifdef SQU1D_TRACING
+constexpr bool ENABLED = true;
+#else
+constexpr bool ENABLED = false;
+#endif
+
+uint64_t now_ns();
+
+// Name the calling thread in the trace
+void set_thread_name(const char* name);
+
+// One finished span on the calling thread; name must outlive the trace
+// (a string literal)
+void record(const char* name, uint64_t start_ns, uint64_t end_ns);
+
+// A span measured by another process, shown under its process id
+void record_external(int process_id, const std::string& name, uint64_t start_ns, uint64_t end_ns);
+
+// Write every buffered event to path; false if it could not be written
+bool write_chrome_json(const std::string& path);
+
+class Scope {
+public:
+    explicit Scope(const char* name) : name(name), start(now_ns()) {}
+    ~Scope() { record(name, start, now_ns()); }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    const char* name;
+    uint64_t start;
+};
+
+} // namespace Trace
+
+#ifdef SQU1D_TRACING
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) Trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#endif
+
+// Work time of the most recent frames, for the frame-time HUD. A frame
+// over FRAME_BUDGET_MS counts as dropped.
+class FrameStats {
+public:
+    static constexpr double FRAME_BUDGET_MS = 1000.0 / 60;
+
+    FrameStats();
+
+    void add(double frame_ms);
+
+    // Over the frames still in the window; 0 before the first frame
+    double last() const;
+    double p99() const;
+    int dropped() const { return dropped_frames; }
+    int count() const { return static_cast<int>(std::min(total, times.size())); }
+
+private:
+    std::vector<double> times; // ring of the latest frame times
+    size_t total = 0;
+    int dropped_frames = 0; // within the window
+    mutable std::vector<double> sorted;
+};
@@ -1,66 +1,307 @@
 #include "ui_renderer.h"
-#include "../../shared/bitmap_font.h"
+#include "trace.h"
 #include <algorithm>
 #include <cmath>
 
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define SQU1D_UI_X86 1
+#endif
+
+namespace {
+
+// Span fill kernels: write count copies of one pixel. The widest one the
+// CPU supports is picked once at startup.
+using SpanFill = void (*)(uint32_t* dst, size_t count, uint32_t pixel);
+
+// Spans at least this long (in pixels, 1 MB) bypass the cache: a full clear
+// is far larger than L2 and would only evict what the present step needs.
+constexpr size_t STREAMING_FILL_PIXELS = 256 * 1024;
+
+void fill_span_generic(uint32_t* dst, size_t count, uint32_t pixel) {
+    std::fill_n(dst, count, pixel);
+}
+
+#ifdef SQU1D_UI_X86
+__attribute__((target("sse2")))
+void fill_span_sse2(uint32_t* dst, size_t count, uint32_t pixel) {
+    const __m128i value = _mm_set1_epi32(static_cast<int>(pixel));
+    size_t i = 0;
+    if (count >= STREAMING_FILL_PIXELS) {
+        for (; reinterpret_cast<uintptr_t>(dst + i) & 15; ++i) {
+            dst[i] = pixel;
+        }
+        for (; i + 4 <= count; i += 4) {
+            _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i), value);
+        }
+        _mm_sfence();
+    }
+    for (; i + 16 <= count; i += 16) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), value);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4), value);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 8), value);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 12), value);
+    }
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), value);
+    }
+    std::fill_n(dst + i, count - i, pixel);
+}
+
+__attribute__((target("avx2")))
+void fill_span_avx2(uint32_t* dst, size_t count, uint32_t pixel) {
+    const __m256i value = _mm256_set1_epi32(static_cast<int>(pixel));
+    size_t i = 0;
+    if (count >= STREAMING_FILL_PIXELS) {
+        for (; reinterpret_cast<uintptr_t>(dst + i) & 31; ++i) {
+            dst[i] = pixel;
+        }
+        for (; i + 8 <= count; i += 8) {
+            _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + i), value);
+        }
+        _mm_sfence();
+    }
+    for (; i + 32 <= count; i += 32) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), value);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 8), value);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 16), value);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 24), value);
+    }
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), value);
+    }
+    std::fill_n(dst + i, count - i, pixel);
+}
+#endif
+
+// Large repaints are split into square tiles of this size and rasterized
+// on the pool; smaller ones are not worth the hand-off
+constexpr int PAINT_TILE_SIZE = 64;
+constexpr size_t PARALLEL_PAINT_PIXELS = 256 * 256;
+
+SpanFill pick_span_fill() {
+#ifdef SQU1D_UI_X86
+    __builtin_cpu_init(); // may run before other static constructors
+    if (__builtin_cpu_supports("avx2")) return fill_span_avx2;
+    if (__builtin_cpu_supports("sse2")) return fill_span_sse2;
+#endif
+    return fill_span_generic;
+}
+
+const SpanFill fill_span = pick_span_fill();
+
+// Spans shorter than this (edge pixels, glyph strokes) are written inline
+// rather than through the kernels
+constexpr size_t SHORT_SPAN_PIXELS = 8;
+
+void paint_long_span(uint32_t* dst, size_t count, uint32_t pixel, BlendMode mode, bool opaque) {
+    if (opaque) {
+        fill_span(dst, count, pixel);
+    } else {
+        blend_span_solid(dst, count, pixel, mode);
+    }
+}
+
+// Fill or blend one span; opaque source-over is a plain fill
+inline void paint_span(uint32_t* dst, size_t count, uint32_t pixel, BlendMode mode) {
+    const bool opaque = mode == BlendMode::SOURCE || (mode == BlendMode::SOURCE_OVER && (pixel >> 24) == 0xff);
+    if (count >= SHORT_SPAN_PIXELS || !(opaque || mode == BlendMode::SOURCE_OVER)) {
+        paint_long_span(dst, count, pixel, mode, opaque);
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = opaque ? pixel : blend_pixel_over(pixel, dst[i]);
+    }
+}
+
+// Paints the coverage spans of one row in one color, clipped to
+// [x_min, x_max)
+struct SpanPainter {
+    uint32_t* row;
+    int x_min;
+    int x_max;
+    uint32_t pixel; // premultiplied, at full coverage
+
+    void operator()(int x, int length, uint8_t coverage) const {
+        const int x0 = std::max(x, x_min);
+        const int x1 = std::min(x + length, x_max);
+        if (x0 < x1) {
+            paint_span(row + x0, static_cast<size_t>(x1 - x0), coverage == 255 ? pixel : scale_pixel(pixel, coverage),
+                       BlendMode::SOURCE_OVER);
+        }
+    }
+};
+
+} // namespace
+
 UIRenderer::UIRenderer(int width, int height)
-    : width(width), height(height) {
-    // Initialize frame buffer (RGBA)
-    frame_buffer.resize(width * height * 4);
+    : width(width), height(height), clip{0, 0, width, height} {
+    // Initialize frame buffer (ARGB8888)
+    frame_buffer.resize(static_cast<size_t>(width) * height);
     clear(Color(255, 255, 255)); // White background
 }
 
 UIRenderer::~UIRenderer() {}
 
+void UIRenderer::resize(int new_width, int new_height) {
+    // Keep the allocation across a window drag: shrinking never frees it,
+    // and growing reserves half again so the next few steps fit
+    const size_t pixels = static_cast<size_t>(new_width) * new_height;
+    if (pixels > frame_buffer.capacity()) {
+        frame_buffer.reserve(std::max(pixels, frame_buffer.capacity() + frame_buffer.capacity() / 2));
+    }
+    frame_buffer.resize(pixels);
+    width = new_width;
+    height = new_height;
+    reset_clip();
+}
+
 void UIRenderer::clear(const Color& color) {
-    for (int i = 0; i < width * height; ++i) {
-        frame_buffer[i * 4 + 0] = color.r;
-        frame_buffer[i * 4 + 1] = color.g;
-        frame_buffer[i * 4 + 2] = color.b;
-        frame_buffer[i * 4 + 3] = color.a;
+    if (clip.x == 0 && clip.y == 0 && clip.width == width && clip.height == height) {
+        fill_span(frame_buffer.data(), frame_buffer.size(), premultiply(color));
+        return;
     }
+    fill_rect_internal(clip, clip.x, clip.y, clip.x + clip.width, clip.y + clip.height, color, BlendMode::SOURCE);
+}
+
+void UIRenderer::set_clip(const PixelRect& rect) {
+    clip = intersect_rects(rect, PixelRect{0, 0, width, height});
 }
 
-void UIRenderer::put_pixel(int x, int y, const Color& color) {
-    if (x < 0 || x >= width || y < 0 || y >= height) {
+void UIRenderer::reset_clip() {
+    clip = PixelRect{0, 0, width, height};
+}
+
+void UIRenderer::paint(const DisplayList& list, const PixelRect& region, const Color& background) {
+    TRACE_SCOPE("paint");
+    const PixelRect area = intersect_rects(region, PixelRect{0, 0, width, height});
+    if (area.width <= 0 || area.height <= 0) {
         return;
     }
-    
-    int idx = (y * width + x) * 4;
-    frame_buffer[idx + 0] = color.r;
-    frame_buffer[idx + 1] = color.g;
-    frame_buffer[idx + 2] = color.b;
-    frame_buffer[idx + 3] = color.a;
+
+    const auto& items = list.get_items();
+    const size_t pixels = static_cast<size_t>(area.width) * area.height;
+    if (!pool || pool->get_thread_count() < 2 || pixels < PARALLEL_PAINT_PIXELS) {
+        fill_rect_internal(area, area.x, area.y, area.x + area.width, area.y + area.height, background,
+                           BlendMode::SOURCE);
+        for (const auto& entry : items) {
+            if (rects_intersect(entry.second.bounds(), area)) {
+                draw_item(area, entry.second);
+            }
+        }
+        return;
+    }
+
+    // Bin the items into tiles, then rasterize tiles in parallel. Every tile
+    // is painted by one thread under its own clip, in the same item order
+    // as the serial path, so the result is identical.
+    const int columns = (area.width + PAINT_TILE_SIZE - 1) / PAINT_TILE_SIZE;
+    const int rows = (area.height + PAINT_TILE_SIZE - 1) / PAINT_TILE_SIZE;
+    std::vector<std::vector<const DisplayItem*>> bins(static_cast<size_t>(columns) * rows);
+    for (const auto& entry : items) {
+        const PixelRect b = intersect_rects(entry.second.bounds(), area);
+        if (b.width <= 0 || b.height <= 0) {
+            continue;
+        }
+        const int c0 = (b.x - area.x) / PAINT_TILE_SIZE;
+        const int c1 = (b.x + b.width - 1 - area.x) / PAINT_TILE_SIZE;
+        const int r0 = (b.y - area.y) / PAINT_TILE_SIZE;
+        const int r1 = (b.y + b.height - 1 - area.y) / PAINT_TILE_SIZE;
+        for (int r = r0; r <= r1; ++r) {
+            for (int c = c0; c <= c1; ++c) {
+                bins[static_cast<size_t>(r) * columns + c].push_back(&entry.second);
+            }
+        }
+    }
+
+    pool->run(bins.size(), [&](size_t index) {
+        TRACE_SCOPE("paint_tile");
+        const int c = static_cast<int>(index % columns);
+        const int r = static_cast<int>(index / columns);
+        const PixelRect tile = intersect_rects(
+            PixelRect{area.x + c * PAINT_TILE_SIZE, area.y + r * PAINT_TILE_SIZE, PAINT_TILE_SIZE, PAINT_TILE_SIZE}, area);
+        fill_rect_internal(tile, tile.x, tile.y, tile.x + tile.width, tile.y + tile.height, background,
+                           BlendMode::SOURCE);
+        for (const DisplayItem* item : bins[index]) {
+            draw_item(tile, *item);
+        }
+    });
 }
 
-void UIRenderer::fill_rect(const Rect& rect, const Color& color) {
-    fill_rect_internal(
+void UIRenderer::draw_item(const PixelRect& area, const DisplayItem& item) {
+    switch (item.kind) {
+        case DisplayItem::Kind::FILL_RECT:
+            fill_rect_internal(area, static_cast<int>(item.rect.x), static_cast<int>(item.rect.y),
+                               static_cast<int>(item.rect.x + item.rect.width),
+                               static_cast<int>(item.rect.y + item.rect.height), item.color);
+            break;
+        case DisplayItem::Kind::STROKE_RECT:
+            draw_rect_internal(area, item.rect, item.color, item.stroke_width);
+            break;
+        case DisplayItem::Kind::ROUNDED_RECT:
+            draw_rounded_rect_internal(area, item.rect, item.color, item.radius, item.stroke_width);
+            break;
+        case DisplayItem::Kind::TEXT:
+            draw_text_internal(item.has_clip() ? intersect_rects(area, item.clip_box()) : area, item.text, item.rect.x,
+                               item.rect.y, item.color, item.font_size);
+            break;
+    }
+}
+
+void UIRenderer::fill_rect(const Rect& rect, const Color& color, BlendMode mode) {
+    fill_rect_internal(clip,
         static_cast<int>(rect.x),
         static_cast<int>(rect.y),
         static_cast<int>(rect.x + rect.width),
         static_cast<int>(rect.y + rect.height),
-        color
+        color,
+        mode
     );
 }
 
-void UIRenderer::fill_rect_internal(int x1, int y1, int x2, int y2, const Color& color) {
-    x1 = std::max(0, x1);
-    y1 = std::max(0, y1);
-    x2 = std::min(width, x2);
-    y2 = std::min(height, y2);
+void UIRenderer::fill_rect_internal(const PixelRect& area, int x1, int y1, int x2, int y2, const Color& color,
+                                    BlendMode mode) {
+    x1 = std::max(area.x, x1);
+    y1 = std::max(area.y, y1);
+    x2 = std::min(area.x + area.width, x2);
+    y2 = std::min(area.y + area.height, y2);
+    if (x1 >= x2 || y1 >= y2) {
+        return;
+    }
     
+    // Clipped once above; each row is a single span
+    const uint32_t pixel = premultiply(color);
+    const size_t span = static_cast<size_t>(x2 - x1);
     for (int y = y1; y < y2; ++y) {
-        for (int x = x1; x < x2; ++x) {
-            put_pixel(x, y, color);
-        }
+        paint_span(&frame_buffer[static_cast<size_t>(y) * width + x1], span, pixel, mode);
     }
 }
 
 void UIRenderer::draw_rect(const Rect& rect, const Color& color, float stroke_width) {
+    draw_rect_internal(clip, rect, color, stroke_width);
+}
+
+void UIRenderer::draw_rounded_rect(const Rect& rect, const Color& color, float radius, float stroke_width) {
+    draw_rounded_rect_internal(clip, rect, color, radius, stroke_width);
+}
+
+void UIRenderer::draw_text(const std::string& text, float x, float y, const Color& color, float font_size) {
+    draw_text_internal(clip, text, x, y, color, font_size);
+}
+
+void UIRenderer::composite(const uint32_t* pixels, int src_width, int src_height, int x, int y, BlendMode mode) {
+    const PixelRect r = intersect_rects(PixelRect{x, y, src_width, src_height}, clip);
+    for (int row = r.y; row < r.y + r.height; ++row) {
+        blend_span(&frame_buffer[static_cast<size_t>(row) * width + r.x],
+                   &pixels[static_cast<size_t>(row - y) * src_width + (r.x - x)], static_cast<size_t>(r.width), mode);
+    }
+}
+
+void UIRenderer::draw_rect_internal(const PixelRect& area, const Rect& rect, const Color& color, float stroke_width) {
     int sw = static_cast<int>(stroke_width);
     
     // Top edge
-    fill_rect_internal(
+    fill_rect_internal(area,
         static_cast<int>(rect.x),
         static_cast<int>(rect.y),
         static_cast<int>(rect.x + rect.width),
@@ -69,7 +310,7 @@ void UIRenderer::draw_rect(const Rect& rect, const Color& color, float stroke_wi
     );
     
     // Bottom edge
-    fill_rect_internal(
+    fill_rect_internal(area,
         static_cast<int>(rect.x),
         static_cast<int>(rect.y + rect.height - sw),
         static_cast<int>(rect.x + rect.width),
@@ -78,7 +319,7 @@ void UIRenderer::draw_rect(const Rect& rect, const Color& color, float stroke_wi
     );
     
     // Left edge
-    fill_rect_internal(
+    fill_rect_internal(area,
         static_cast<int>(rect.x),
         static_cast<int>(rect.y),
         static_cast<int>(rect.x + sw),
@@ -87,7 +328,7 @@ void UIRenderer::draw_rect(const Rect& rect, const Color& color, float stroke_wi
     );
     
     // Right edge
-    fill_rect_internal(
+    fill_rect_internal(area,
         static_cast<int>(rect.x + rect.width - sw),
         static_cast<int>(rect.y),
         static_cast<int>(rect.x + rect.width),
@@ -96,91 +337,53 @@ void UIRenderer::draw_rect(const Rect& rect, const Color& color, float stroke_wi
     );
 }
 
-void UIRenderer::draw_rounded_rect(const Rect& rect, const Color& color, float radius, float stroke_width) {
-    // Simplified rounded rectangle - draw corners
-    int r = static_cast<int>(radius);
-    
-    // Draw main rectangle
-    fill_rect_internal(
-        static_cast<int>(rect.x + r),
-        static_cast<int>(rect.y),
-        static_cast<int>(rect.x + rect.width - r),
-        static_cast<int>(rect.y + rect.height),
-        color
-    );
-    
-    // Left and right columns
-    fill_rect_internal(
-        static_cast<int>(rect.x),
-        static_cast<int>(rect.y + r),
-        static_cast<int>(rect.x + rect.width),
-        static_cast<int>(rect.y + rect.height - r),
-        color
-    );
-}
-
-void UIRenderer::draw_text(const std::string& text, float x, float y, const Color& color, float font_size) {
-    // Use bitmap font for text rendering
-    int px = static_cast<int>(x);
-    int py = static_cast<int>(y);
-    
-    for (char c : text) {
-        draw_char(frame_buffer.data(), width, height, px, py, c, color.r, color.g, color.b);
-        px += 4; // 3 pixels for char + 1 pixel spacing
+void UIRenderer::draw_rounded_rect_internal(const PixelRect& area, const Rect& rect, const Color& color, float radius,
+                                            float stroke_width) {
+    const RoundedRectScan scan(corners, static_cast<int>(rect.x), static_cast<int>(rect.y),
+                               static_cast<int>(rect.x + rect.width), static_cast<int>(rect.y + rect.height), radius,
+                               stroke_width, antialias);
+    const int y_end = std::min(scan.bottom(), area.y + area.height);
+    SpanPainter painter{nullptr, area.x, area.x + area.width, premultiply(color)};
+    for (int y = std::max(scan.top(), area.y); y < y_end; ++y) {
+        painter.row = &frame_buffer[static_cast<size_t>(y) * width];
+        scan.row(y, painter);
     }
 }
 
-void UIRenderer::draw_toolbar(int height) {
-    Rect toolbar_rect(0, 0, width, height);
-    fill_rect(toolbar_rect, Theme::TOOLBAR_BG);
-    draw_rect(toolbar_rect, Theme::SEPARATOR, 1.0f);
-}
-
-void UIRenderer::draw_tab(const Rect& rect, const std::string& title, bool is_active) {
-    // Draw tab background
-    Color bg = is_active ? Theme::TAB_BG_ACTIVE : Theme::TAB_BG_INACTIVE;
-    fill_rect(rect, bg);
-    
-    // Draw tab border with rounded corners
-    draw_rounded_rect(rect, Theme::SEPARATOR, 4.0f, 1.0f);
-    
-    // Draw tab text
-    draw_text(title, rect.x + 10, rect.y + 5, Theme::TAB_TEXT, 11.0f);
-}
-
-void UIRenderer::draw_url_bar(const Rect& rect, const std::string& url, bool focused) {
-    fill_rect(rect, Theme::URLBAR_BG);
-    
-    Color border = focused ? Color(100, 150, 255) : Theme::URLBAR_BORDER;
-    draw_rounded_rect(rect, border, 6.0f, 1.0f);
-    
-    draw_text(url, rect.x + 8, rect.y + 8, Theme::TEXT_PRIMARY, 12.0f);
-}
+void UIRenderer::draw_text_internal(const PixelRect& area, const std::string& text, float x, float y, const Color& color,
+                                    float font_size) {
+    // Cached, pre-scaled glyph runs: one span fill per covered run
+    auto run = glyphs.get_run(text, font_size);
+    const int ox = static_cast<int>(x);
+    const int oy = static_cast<int>(y);
+    if (ox >= area.x + area.width || oy >= area.y + area.height || ox + run->width <= area.x ||
+        oy + run->height <= area.y) {
+        return;
+    }
 
-void UIRenderer::draw_button(const Rect& rect, const std::string& label, bool hovered) {
-    Color bg = hovered ? Theme::BUTTON_HOVER : Theme::BUTTON_BG;
-    fill_rect(rect, bg);
-    draw_rounded_rect(rect, Theme::SEPARATOR, 4.0f, 1.0f);
-    
-    draw_text(label, rect.x + 5, rect.y + 5, Theme::TEXT_PRIMARY, 11.0f);
+    const uint32_t pixel = premultiply(color);
+    const int x_min = area.x;
+    const int x_max = area.x + area.width;
+    for (const auto& span : run->spans) {
+        const int py = oy + span.y;
+        if (py < area.y || py >= area.y + area.height) {
+            continue;
+        }
+        const int x0 = std::max(ox + span.x, x_min);
+        const int x1 = std::min(ox + span.x + span.length, x_max);
+        if (x0 < x1) {
+            paint_span(&frame_buffer[static_cast<size_t>(py) * width + x0], static_cast<size_t>(x1 - x0), pixel,
+                       BlendMode::SOURCE_OVER);
+        }
+    }
 }
 
-void UIRenderer::draw_line(float x1, float y1, float x2, float y2, const Color& color) {
-    // Bresenham line algorithm (simplified)
-    int dx = static_cast<int>(x2 - x1);
-    int dy = static_cast<int>(y2 - y1);
-    
-    int steps = std::max(std::abs(dx), std::abs(dy));
-    if (steps == 0) return;
-    
-    float x_inc = dx / static_cast<float>(steps);
-    float y_inc = dy / static_cast<float>(steps);
-    
-    for (int i = 0; i <= steps; ++i) {
-        put_pixel(
-            static_cast<int>(x1 + i * x_inc),
-            static_cast<int>(y1 + i * y_inc),
-            color
-        );
+void UIRenderer::draw_line(float x1, float y1, float x2, float y2, const Color& color, float line_width) {
+    const LineScan scan(x1, y1, x2, y2, line_width, antialias);
+    const int y_end = std::min(scan.bottom(), clip.y + clip.height);
+    SpanPainter painter{nullptr, clip.x, clip.x + clip.width, premultiply(color)};
+    for (int y = std::max(scan.top(), clip.y); y < y_end; ++y) {
+        painter.row = &frame_buffer[static_cast<size_t>(y) * width];
+        scan.row(y, painter);
     }
 }
@@ -1,6 +1,11 @@
 #pragma once
 
 #include "ui_types.h"
+#include "display_list.h"
+#include "work_pool.h"
+#include "glyph_cache.h"
+#include "compositor.h"
+#include "scanline.h"
 #include <cstdint>
 #include <vector>
 
@@ -9,31 +14,63 @@ public:
     UIRenderer(int width, int height);
     ~UIRenderer();
 
-    // Drawing primitives
+    // Change the framebuffer size, reusing its memory where possible.
+    // The contents are undefined afterwards; repaint everything.
+    void resize(int new_width, int new_height);
+
+    // Drawing primitives. Colors are straight alpha and composite
+    // source-over unless a mode says otherwise; clear() replaces.
     void clear(const Color& color);
-    void fill_rect(const Rect& rect, const Color& color);
+    void fill_rect(const Rect& rect, const Color& color, BlendMode mode = BlendMode::SOURCE_OVER);
     void draw_rect(const Rect& rect, const Color& color, float stroke_width = 1.0f);
+    // stroke_width <= 0 fills the rounded rect, otherwise draws its border
     void draw_rounded_rect(const Rect& rect, const Color& color, float radius, float stroke_width = 1.0f);
+    void draw_line(float x1, float y1, float x2, float y2, const Color& color, float line_width = 1.0f);
     void draw_text(const std::string& text, float x, float y, const Color& color, float font_size = 12.0f);
+
+    // Blend a premultiplied ARGB8888 image, src_width pixels per row, with
+    // its top-left corner at (x, y)
+    void composite(const uint32_t* pixels, int src_width, int src_height, int x, int y,
+                   BlendMode mode = BlendMode::SOURCE_OVER);
     
-    // High-level UI elements (Falkon macOS inspired)
-    void draw_toolbar(int height);
-    void draw_tab(const Rect& rect, const std::string& title, bool is_active);
-    void draw_url_bar(const Rect& rect, const std::string& url, bool focused);
-    void draw_button(const Rect& rect, const std::string& label, bool hovered = false);
+    // Smooth the edges of rounded rects and lines (on by default)
+    void set_antialias(bool enabled) { antialias = enabled; }
+
+    // Restrict every primitive to rect (clipped to the framebuffer)
+    void set_clip(const PixelRect& rect);
+    void reset_clip();
+
+    // Repaint one region from a retained display list: clear it to
+    // background, then replay the items that touch it. Large regions are
+    // rasterized in 64x64 tiles on the pool, if one is set.
+    void paint(const DisplayList& list, const PixelRect& region, const Color& background);
+    void set_thread_pool(WorkStealingPool* thread_pool) { pool = thread_pool; }
     
-    // Get rendered frame
-    const std::vector<uint8_t>& get_frame_buffer() const { return frame_buffer; }
+    // Get rendered frame, one premultiplied pixel per element, width pixels per row
+    const std::vector<uint32_t>& get_frame_buffer() const { return frame_buffer; }
+    PixelFormat get_format() const { return PixelFormat::ARGB8888; }
     
     int get_width() const { return width; }
     int get_height() const { return height; }
 
 private:
     int width, height;
-    std::vector<uint8_t> frame_buffer; // RGBA format
+    std::vector<uint32_t> frame_buffer; // premultiplied ARGB8888, the usual window surface layout
+    PixelRect clip;
+    WorkStealingPool* pool = nullptr; // not owned
+    GlyphCache glyphs;
+    CornerCache corners;
+    bool antialias = true;
     
     // Helper methods
-    void put_pixel(int x, int y, const Color& color);
-    void draw_line(float x1, float y1, float x2, float y2, const Color& color);
-    void fill_rect_internal(int x1, int y1, int x2, int y2, const Color& color);
+    // Primitives clipped to an explicit area (already inside the
+    // framebuffer), so tiles can be drawn concurrently
+    void fill_rect_internal(const PixelRect& area, int x1, int y1, int x2, int y2, const Color& color,
+                            BlendMode mode = BlendMode::SOURCE_OVER);
+    void draw_rect_internal(const PixelRect& area, const Rect& rect, const Color& color, float stroke_width);
+    void draw_rounded_rect_internal(const PixelRect& area, const Rect& rect, const Color& color, float radius,
+                                    float stroke_width);
+    void draw_text_internal(const PixelRect& area, const std::string& text, float x, float y, const Color& color,
+                            float font_size);
+    void draw_item(const PixelRect& area, const DisplayItem& item);
 };
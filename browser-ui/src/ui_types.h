@@ -20,6 +20,11 @@ struct Rect {
     }
 };
 
+// Integer pixel rectangle, e.g. a damaged region of a frame
+struct PixelRect {
+    int x, y, width, height;
+};
+
 struct Color {
     uint8_t r, g, b, a;
 
@@ -36,6 +41,14 @@ struct Color {
     }
 };
 
+// In-memory pixel layouts. ARGB8888 is one native-endian uint32_t per pixel
+// (0xAARRGGBB, bytes B,G,R,A on little-endian hosts), which is what SDL
+// window surfaces normally use; RGBA8888 is bytes R,G,B,A.
+enum class PixelFormat {
+    RGBA8888,
+    ARGB8888,
+};
+
 // Falkon macOS-inspired theme colors
 namespace Theme {
     constexpr Color TOOLBAR_BG = Color(240, 240, 240);
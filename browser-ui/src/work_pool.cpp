@@ -0,0 +1,113 @@
+#include "work_pool.h"
+#include "trace.h"
+#include <algorithm>
+
+WorkStealingPool::WorkStealingPool(int thread_count) {
+    if (thread_count <= 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (int i = 0; i < thread_count; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (int i = 1; i < thread_count; ++i) {
+        threads.emplace_back(&WorkStealingPool::worker_loop, this, static_cast<size_t>(i));
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void WorkStealingPool::run(size_t count, const std::function<void(size_t)>& job) {
+    if (count == 0) {
+        return;
+    }
+    if (queues.size() == 1) {
+        for (size_t i = 0; i < count; ++i) {
+            job(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        task = &job;
+        remaining.store(count);
+
+        // Contiguous slices keep neighbouring tasks on one thread
+        const size_t n = queues.size();
+        for (size_t q = 0; q < n; ++q) {
+            std::lock_guard<std::mutex> queue_lock(queues[q]->mutex);
+            for (size_t i = q * count / n; i < (q + 1) * count / n; ++i) {
+                queues[q]->tasks.push_back(i);
+            }
+        }
+        ++generation;
+    }
+    work_ready.notify_all();
+
+    work(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    work_done.wait(lock, [this] { return remaining.load() == 0; });
+    task = nullptr;
+}
+
+bool WorkStealingPool::pop_or_steal(size_t self, size_t& index) {
+    {
+        Queue& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            index = own.tasks.back();
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    for (size_t offset = 1; offset < queues.size(); ++offset) {
+        Queue& victim = *queues[(self + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            index = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::work(size_t self) {
+    size_t index;
+    while (pop_or_steal(self, index)) {
+        // task was published before any index was queued
+        (*task)(index);
+        if (remaining.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(mutex);
+            work_done.notify_all();
+        }
+    }
+}
+
+void WorkStealingPool::worker_loop(size_t self) {
+    Trace::set_thread_name("raster");
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        work_ready.wait(lock, [&] { return stopping || generation != seen; });
+        if (stopping) {
+            return;
+        }
+        seen = generation;
+        lock.unlock();
+        work(self);
+        lock.lock();
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads for data-parallel work such as rasterizing tiles.
+// Each participant owns a deque of task indices and pops from its back;
+// once empty it steals from the front of the others, so uneven tiles
+// balance out without a central queue.
+class WorkStealingPool {
+public:
+    // thread_count counts the calling thread; <= 0 uses one per hardware thread
+    explicit WorkStealingPool(int thread_count = 0);
+    ~WorkStealingPool();
+
+    // Run task(i) for every i in [0, count) and return when all are done.
+    // The calling thread takes part. Only one run() at a time.
+    void run(size_t count, const std::function<void(size_t)>& task);
+
+    int get_thread_count() const { return static_cast<int>(queues.size()); }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    bool pop_or_steal(size_t self, size_t& index);
+    void work(size_t self);
+    void worker_loop(size_t self);
+
+    std::vector<std::unique_ptr<Queue>> queues; // queues[0] belongs to the caller of run()
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable work_done;
+    const std::function<void(size_t)>* task = nullptr;
+    std::atomic<size_t> remaining{0};
+    uint64_t generation = 0;
+    bool stopping = false;
+};
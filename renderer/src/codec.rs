@@ -0,0 +1,157 @@
+// Fast lossless image codec for tab snapshots and IPC, following the QOI
+// format (https://qoiformat.org): a 14-byte header, then a byte stream of
+// run / index / diff / luma / literal ops, then an 8-byte end marker.
+// Rendered pages are dominated by long runs of background colour, which
+// collapse to one byte per 62 pixels.
+
+const OP_INDEX: u8 = 0x00; // 00xxxxxx
+const OP_DIFF: u8 = 0x40; // 01xxxxxx
+const OP_LUMA: u8 = 0x80; // 10xxxxxx
+const OP_RUN: u8 = 0xc0; // 11xxxxxx
+const OP_RGB: u8 = 0xfe;
+const OP_RGBA: u8 = 0xff;
+const MASK_2: u8 = 0xc0;
+
+const HEADER_LEN: usize = 14;
+const END_MARKER: [u8; 8] = [0, 0, 0, 0, 0, 0, 0, 1];
+
+fn hash(px: [u8; 4]) -> usize {
+    (px[0] as usize * 3 + px[1] as usize * 5 + px[2] as usize * 7 + px[3] as usize * 11) % 64
+}
+
+/// Encode tightly packed RGBA pixels.
+pub fn qoi_encode(pixels: &[u8], width: u32, height: u32) -> Vec<u8> {
+    let px_count = width as usize * height as usize;
+    let pixels = &pixels[..px_count * 4];
+
+    // Worst case is one RGBA literal per pixel; pages are far below that
+    let mut out = Vec::with_capacity(HEADER_LEN + px_count / 8 + END_MARKER.len());
+    out.extend_from_slice(b"qoif");
+    out.extend_from_slice(&width.to_be_bytes());
+    out.extend_from_slice(&height.to_be_bytes());
+    out.push(4); // channels
+    out.push(0); // sRGB with linear alpha
+
+    let mut index = [[0u8; 4]; 64];
+    let mut prev = [0u8, 0, 0, 255];
+    let word = |i: usize| u32::from_ne_bytes([pixels[i * 4], pixels[i * 4 + 1], pixels[i * 4 + 2], pixels[i * 4 + 3]]);
+
+    let mut i = 0;
+    while i < px_count {
+        // Scan a whole run before emitting it: 16 pixels per block compare
+        // (a memcmp), then single pixels for the remainder
+        let prev_word = u32::from_ne_bytes(prev);
+        if word(i) == prev_word {
+            let start = i;
+            let mut block = [0u8; 64];
+            for px in block.chunks_exact_mut(4) {
+                px.copy_from_slice(&prev);
+            }
+            while i + 16 <= px_count && pixels[i * 4..(i + 16) * 4] == block[..] {
+                i += 16;
+            }
+            while i < px_count && word(i) == prev_word {
+                i += 1;
+            }
+            let mut run = i - start;
+            while run > 0 {
+                let n = run.min(62);
+                out.push(OP_RUN | (n as u8 - 1));
+                run -= n;
+            }
+            continue;
+        }
+
+        let px = word(i).to_ne_bytes();
+        i += 1;
+
+        let slot = hash(px);
+        if index[slot] == px {
+            out.push(OP_INDEX | slot as u8);
+        } else {
+            index[slot] = px;
+            if px[3] == prev[3] {
+                let dr = px[0].wrapping_sub(prev[0]) as i8;
+                let dg = px[1].wrapping_sub(prev[1]) as i8;
+                let db = px[2].wrapping_sub(prev[2]) as i8;
+                let dr_dg = dr.wrapping_sub(dg);
+                let db_dg = db.wrapping_sub(dg);
+
+                if (-2..=1).contains(&dr) && (-2..=1).contains(&dg) && (-2..=1).contains(&db) {
+                    out.push(OP_DIFF | (((dr + 2) as u8) << 4) | (((dg + 2) as u8) << 2) | (db + 2) as u8);
+                } else if (-32..=31).contains(&dg) && (-8..=7).contains(&dr_dg) && (-8..=7).contains(&db_dg) {
+                    out.push(OP_LUMA | (dg + 32) as u8);
+                    out.push((((dr_dg + 8) as u8) << 4) | (db_dg + 8) as u8);
+                } else {
+                    out.extend_from_slice(&[OP_RGB, px[0], px[1], px[2]]);
+                }
+            } else {
+                out.extend_from_slice(&[OP_RGBA, px[0], px[1], px[2], px[3]]);
+            }
+        }
+        prev = px;
+    }
+
+    out.extend_from_slice(&END_MARKER);
+    out
+}
+
+/// Decode a stream produced by `qoi_encode` (or any 3/4-channel QOI image)
+/// into tightly packed RGBA. Returns `(width, height, pixels)`.
+pub fn qoi_decode(data: &[u8]) -> Result<(u32, u32, Vec<u8>), String> {
+    if data.len() < HEADER_LEN + END_MARKER.len() || &data[..4] != b"qoif" {
+        return Err("not a QOI image".to_string());
+    }
+    let width = u32::from_be_bytes([data[4], data[5], data[6], data[7]]);
+    let height = u32::from_be_bytes([data[8], data[9], data[10], data[11]]);
+    let px_count = width as usize * height as usize;
+
+    let mut pixels = vec![0u8; px_count * 4];
+    let mut index = [[0u8; 4]; 64];
+    let mut px = [0u8, 0, 0, 255];
+    let mut pos = HEADER_LEN;
+    let end = data.len() - END_MARKER.len();
+    let mut i = 0;
+
+    while i < px_count {
+        let mut repeat = 1;
+        if pos < end {
+            let b1 = data[pos];
+            pos += 1;
+            if b1 == OP_RGB {
+                px[..3].copy_from_slice(data.get(pos..pos + 3).ok_or("truncated QOI stream")?);
+                pos += 3;
+            } else if b1 == OP_RGBA {
+                px.copy_from_slice(data.get(pos..pos + 4).ok_or("truncated QOI stream")?);
+                pos += 4;
+            } else {
+                match b1 & MASK_2 {
+                    OP_INDEX => px = index[b1 as usize],
+                    OP_DIFF => {
+                        px[0] = px[0].wrapping_add(((b1 >> 4) & 0x03).wrapping_sub(2));
+                        px[1] = px[1].wrapping_add(((b1 >> 2) & 0x03).wrapping_sub(2));
+                        px[2] = px[2].wrapping_add((b1 & 0x03).wrapping_sub(2));
+                    }
+                    OP_LUMA => {
+                        let b2 = *data.get(pos).ok_or("truncated QOI stream")?;
+                        pos += 1;
+                        let dg = (b1 & 0x3f).wrapping_sub(32);
+                        px[0] = px[0].wrapping_add(dg.wrapping_sub(8).wrapping_add((b2 >> 4) & 0x0f));
+                        px[1] = px[1].wrapping_add(dg);
+                        px[2] = px[2].wrapping_add(dg.wrapping_sub(8).wrapping_add(b2 & 0x0f));
+                    }
+                    _ => repeat = (b1 & 0x3f) as usize + 1, // OP_RUN
+                }
+            }
+            index[hash(px)] = px;
+        }
+
+        let n = repeat.min(px_count - i);
+        for out in pixels[i * 4..(i + n) * 4].chunks_exact_mut(4) {
+            out.copy_from_slice(&px);
+        }
+        i += n;
+    }
+
+    Ok((width, height, pixels))
+}
@@ -21,14 +21,16 @@ impl HtmlParser {
 }
 
 struct SimpleTokenizer {
-    input: String,
+    // Decoded once so peek() is O(1); indexing a String by char position
+    // made parsing quadratic in document size.
+    input: Vec<char>,
     pos: usize,
 }
 
 impl SimpleTokenizer {
     fn new(input: &str) -> Self {
         SimpleTokenizer {
-            input: input.to_string(),
+            input: input.chars().collect(),
             pos: 0,
         }
     }
@@ -236,11 +238,11 @@ impl SimpleTokenizer {
 
     fn skip_comment(&mut self) {
         // Handle HTML comments <!-- ... --> and DOCTYPE/other declarations <! ... >
-        if self.input[self.pos..].starts_with("!--") {
+        if self.input[self.pos..].starts_with(&['!', '-', '-']) {
             // comment: consume until -->
             self.pos += 3; // skip "!--"
             while self.pos < self.input.len() {
-                if self.input[self.pos..].starts_with("-->") {
+                if self.input[self.pos..].starts_with(&['-', '-', '>']) {
                     self.pos += 3;
                     break;
                 }
@@ -270,7 +272,7 @@ impl SimpleTokenizer {
     }
 
     fn peek(&self) -> Option<char> {
-        self.input.chars().nth(self.pos)
+        self.input.get(self.pos).copied()
     }
 
     fn next(&mut self) {
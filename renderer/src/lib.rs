@@ -5,6 +5,11 @@ pub mod dom;
 pub mod layout;
 pub mod http_client;
 pub mod bitmap_font;
+pub mod shared_frame;
+pub mod protocol;
+pub mod codec;
+pub mod damage;
+pub mod trace;
 
 pub use dom::Document;
 pub use layout::LayoutTree;
@@ -1,13 +1,34 @@
 use squ1d_renderer::{
-    html_parser::HtmlParser, renderer::PageRenderer,
+    damage::FrameCache,
+    html_parser::HtmlParser,
+    protocol::{self, RenderJob, RenderResult, Request},
+    renderer::{self, Canvas, PageRenderer, PixelFormat},
+    shared_frame::SharedFrame,
+    trace::Spans,
 };
+use std::collections::{HashSet, VecDeque};
 use std::env;
+use std::sync::mpsc;
 
 fn main() -> Result<(), Box<dyn std::error::Error>> {
-    let args: Vec<String> = env::args().collect();
+    let mut args: Vec<String> = env::args().collect();
+
+    // Long-lived mode used by the browser UI: renderer --serve <frame_fd>
+    if args.len() >= 3 && args[1] == "--serve" {
+        let fd: i32 = args[2].parse()?;
+        return serve(fd);
+    }
+
+    // Output format: --format rgba|bgra|bmp|qoi (default bmp)
+    let mut format = PixelFormat::Bmp;
+    if let Some(i) = args.iter().position(|a| a == "--format") {
+        let name = args.get(i + 1).cloned().unwrap_or_default();
+        format = PixelFormat::parse(&name).ok_or_else(|| format!("unknown format '{}'", name))?;
+        args.drain(i..(i + 2).min(args.len()));
+    }
 
     // Parse command-line arguments
-    // Usage: renderer [html_or_url] [width] [height] [output_file]
+    // Usage: renderer [html_or_url] [width] [height] [output_file] [--format rgba|bgra|bmp|qoi]
     // Example: renderer "<html>...</html>" 800 600 /tmp/render.bmp
     // Or with default test HTML if no args
     let (input, width, height, output_file) = if args.len() >= 4 {
@@ -49,12 +70,128 @@ fn main() -> Result<(), Box<dyn std::error::Error>> {
 
     eprintln!("Rendered {}x{} image with {} bytes", output.width, output.height, output.pixels.len());
 
-    // Save BMP to specified location
-    if let Err(e) = output.to_bmp(&output_file) {
-        eprintln!("Failed to write BMP: {}", e);
+    // Save to specified location
+    if let Err(e) = output.save(&output_file, format) {
+        eprintln!("Failed to write {:?} output: {}", format, e);
     } else {
         eprintln!("Wrote {}", output_file);
     }
 
     Ok(())
 }
+
+/// Serve framed render requests (see `protocol.rs`) from stdin until the UI
+/// closes the pipe. Every render job gets exactly one result frame.
+///
+/// Requests are read on a separate thread so a cancel that arrives while a
+/// page is being painted is seen before the result is sent; a cancelled job
+/// is answered with `STATUS_CANCELLED` and its pixels must be ignored.
+///
+/// The last frame of a few surfaces is kept so re-renders of a tab that
+/// still shows this process's frame only report the damaged rects.
+fn serve(frame_fd: i32) -> Result<(), Box<dyn std::error::Error>> {
+    let (tx, rx) = mpsc::channel();
+    std::thread::spawn(move || {
+        let stdin = std::io::stdin();
+        let mut input = stdin.lock();
+        loop {
+            match protocol::read_request(&mut input) {
+                Ok(Some(request)) => {
+                    if tx.send(request).is_err() {
+                        break;
+                    }
+                }
+                Ok(None) => break,
+                Err(e) => {
+                    eprintln!("Dropping renderer connection: {}", e);
+                    break;
+                }
+            }
+        }
+    });
+
+    let mut frame = SharedFrame::new(frame_fd);
+    let stdout = std::io::stdout();
+    let mut output = stdout.lock();
+    let mut pending: VecDeque<Request> = VecDeque::new();
+    let mut cancelled: HashSet<u32> = HashSet::new();
+    let mut previous = FrameCache::new(4);
+
+    loop {
+        let request = match pending.pop_front() {
+            Some(request) => request,
+            None => match rx.recv() {
+                Ok(request) => request,
+                Err(_) => return Ok(()), // UI went away
+            },
+        };
+
+        let (job_id, job) = match request {
+            Request::Cancel { job_id } => {
+                cancelled.insert(job_id);
+                continue;
+            }
+            Request::Render { job_id, job } => (job_id, job),
+        };
+
+        let mut spans = Spans::new(job.trace);
+        let result = if cancelled.contains(&job_id) {
+            RenderResult::cancelled()
+        } else {
+            render_job(&mut frame, &mut previous, job_id, &job, &mut spans)
+        };
+
+        // Pick up cancels that arrived while we were painting
+        while let Ok(request) = rx.try_recv() {
+            match request {
+                Request::Cancel { job_id } => {
+                    cancelled.insert(job_id);
+                }
+                other => pending.push_back(other),
+            }
+        }
+
+        let result = if cancelled.contains(&job_id) { RenderResult::cancelled() } else { result };
+        // Job ids only grow, so older cancels can never match again
+        cancelled.retain(|&id| id > job_id);
+        if !spans.spans.is_empty() {
+            protocol::write_trace(&mut output, job_id, &spans.spans)?;
+        }
+        protocol::write_result(&mut output, job_id, &result)?;
+    }
+}
+
+fn render_job(frame: &mut SharedFrame, previous: &mut FrameCache, job_id: u32, job: &RenderJob,
+              spans: &mut Spans) -> RenderResult {
+    let format = match PixelFormat::from_code(job.pixel_format) {
+        Some(format) => format,
+        None => return RenderResult::error(format!("unsupported pixel format {}", job.pixel_format)),
+    };
+    let needed = job.width as usize * job.height as usize * 4;
+    let start = job.frame_offset;
+    if start > job.frame_capacity || needed > job.frame_capacity - start {
+        return RenderResult::error(format!("frame too small for {}x{}", job.width, job.height));
+    }
+
+    let doc = match spans.time("parse", || HtmlParser::parse(&String::from_utf8_lossy(&job.document))) {
+        Ok(doc) => doc,
+        Err(e) => return RenderResult::error(e),
+    };
+    let pixels = match frame.map(job.frame_capacity) {
+        Ok(pixels) => pixels,
+        Err(e) => return RenderResult::error(e),
+    };
+
+    spans.time("layout_paint", || {
+        PageRenderer::render_into(&doc, &mut Canvas { width: job.width, height: job.height, pixels: &mut pixels[start..start + needed] })
+    });
+    spans.time("convert_pixels", || renderer::convert_pixels(&mut pixels[start..start + needed], format));
+
+    let mut result = RenderResult::ok(job.width, job.height, job.pixel_format);
+    result.damage = spans.time("diff", || {
+        previous.update(job.surface_id, job_id, job.base_job_id, job.width, job.height, job.pixel_format,
+                        &pixels[start..start + needed])
+    });
+    result.frame_offset = start as u64;
+    result
+}
@@ -0,0 +1,209 @@
+// Binary framed protocol spoken between the browser UI (RendererBridge) and
+// `renderer --serve` over the child's stdin/stdout.
+//
+// Every message starts with a 16-byte little-endian frame header:
+//   u32 magic ("SQRP"), u16 type, u16 flags, u32 job_id, u32 payload_len
+// followed by `payload_len` bytes of payload. Layouts must stay in sync with
+// browser-ui/src/render_protocol.h.
+
+use crate::trace::Span;
+use std::io::{self, Read, Write};
+
+pub const MAGIC: u32 = 0x5052_5153; // "SQRP"
+pub const FRAME_HEADER_LEN: usize = 16;
+pub const RENDER_JOB_HEADER_LEN: usize = 40;
+pub const RESULT_HEADER_LEN: usize = 32;
+pub const DAMAGE_RECT_LEN: usize = 16;
+
+pub const MSG_RENDER_JOB: u16 = 1;
+pub const MSG_CANCEL: u16 = 2;
+pub const MSG_RESULT: u16 = 3;
+pub const MSG_TRACE: u16 = 4;
+
+/// Render job flag: send the job's spans in a TRACE frame ahead of its
+/// result. Payload: u32 span_count, then per span u64 start_ns, u64 end_ns
+/// (CLOCK_MONOTONIC), u32 name_len and the UTF-8 name.
+pub const JOB_FLAG_TRACE: u16 = 1;
+
+/// Result flag: the frame holds only `rect_count` damage rects relative to
+/// the job's `base_job_id` frame; everything else is unchanged.
+pub const RESULT_FLAG_DAMAGE: u16 = 1;
+
+pub const STATUS_OK: u32 = 0;
+pub const STATUS_ERROR: u32 = 1;
+pub const STATUS_CANCELLED: u32 = 2;
+
+pub const PIXEL_FORMAT_RGBA8888: u32 = 1;
+pub const PIXEL_FORMAT_BGRA8888_PREMUL: u32 = 2;
+
+/// Render job payload: u32 width, u32 height, u32 pixel_format,
+/// u32 surface_id, u64 frame_capacity, u32 base_job_id, u32 reserved,
+/// u64 frame_offset, then the HTML document bytes. `surface_id` (0 = none)
+/// names the tab so the renderer can diff against the frame of
+/// `base_job_id` it painted before. The pixels go at `frame_offset` in the
+/// shared frame: the UI keeps earlier frames alive elsewhere in it.
+pub struct RenderJob {
+    pub width: u32,
+    pub height: u32,
+    pub pixel_format: u32,
+    pub surface_id: u32,
+    pub frame_capacity: usize,
+    pub base_job_id: u32,
+    pub frame_offset: usize,
+    pub trace: bool,
+    pub document: Vec<u8>,
+}
+
+pub enum Request {
+    Render { job_id: u32, job: RenderJob },
+    Cancel { job_id: u32 },
+}
+
+/// Result payload: u32 status, u32 width, u32 height, u32 stride,
+/// u32 pixel_format, u32 rect_count, u64 frame_offset, then `rect_count`
+/// damage rects (u32 x, y, width, height) and an optional UTF-8 error
+/// message. With `RESULT_FLAG_DAMAGE` only the pixels inside the rects are
+/// valid in the frame (at their usual position, `stride` bytes per row).
+pub struct RenderResult {
+    pub status: u32,
+    pub width: u32,
+    pub height: u32,
+    pub stride: u32,
+    pub pixel_format: u32,
+    pub frame_offset: u64,
+    pub damage: Option<Vec<DamageRect>>,
+    pub message: String,
+}
+
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub struct DamageRect {
+    pub x: u32,
+    pub y: u32,
+    pub width: u32,
+    pub height: u32,
+}
+
+impl RenderResult {
+    pub fn ok(width: u32, height: u32, pixel_format: u32) -> Self {
+        Self { status: STATUS_OK, width, height, stride: width * 4, pixel_format, frame_offset: 0, damage: None, message: String::new() }
+    }
+
+    pub fn error(message: String) -> Self {
+        Self { status: STATUS_ERROR, width: 0, height: 0, stride: 0, pixel_format: 0, frame_offset: 0, damage: None, message }
+    }
+
+    pub fn cancelled() -> Self {
+        Self { status: STATUS_CANCELLED, ..Self::error(String::new()) }
+    }
+}
+
+fn u16_at(b: &[u8], at: usize) -> u16 {
+    u16::from_le_bytes([b[at], b[at + 1]])
+}
+
+fn u32_at(b: &[u8], at: usize) -> u32 {
+    u32::from_le_bytes([b[at], b[at + 1], b[at + 2], b[at + 3]])
+}
+
+fn u64_at(b: &[u8], at: usize) -> u64 {
+    (u32_at(b, at) as u64) | ((u32_at(b, at + 4) as u64) << 32)
+}
+
+fn invalid(msg: &str) -> io::Error {
+    io::Error::new(io::ErrorKind::InvalidData, msg.to_string())
+}
+
+/// Read the next request. Returns `Ok(None)` on a clean EOF between frames;
+/// unknown message types are skipped.
+pub fn read_request<R: Read>(input: &mut R) -> io::Result<Option<Request>> {
+    loop {
+        let mut header = [0u8; FRAME_HEADER_LEN];
+        match input.read_exact(&mut header) {
+            Ok(()) => {}
+            Err(e) if e.kind() == io::ErrorKind::UnexpectedEof => return Ok(None),
+            Err(e) => return Err(e),
+        }
+        if u32_at(&header, 0) != MAGIC {
+            return Err(invalid("bad frame magic"));
+        }
+        let kind = u16_at(&header, 4);
+        let flags = u16_at(&header, 6);
+        let job_id = u32_at(&header, 8);
+        let payload_len = u32_at(&header, 12) as usize;
+
+        let mut payload = vec![0u8; payload_len];
+        input.read_exact(&mut payload)?;
+
+        match kind {
+            MSG_RENDER_JOB => {
+                if payload_len < RENDER_JOB_HEADER_LEN {
+                    return Err(invalid("short render job"));
+                }
+                let document = payload.split_off(RENDER_JOB_HEADER_LEN);
+                let job = RenderJob {
+                    width: u32_at(&payload, 0),
+                    height: u32_at(&payload, 4),
+                    pixel_format: u32_at(&payload, 8),
+                    surface_id: u32_at(&payload, 12),
+                    frame_capacity: u64_at(&payload, 16) as usize,
+                    base_job_id: u32_at(&payload, 24),
+                    frame_offset: u64_at(&payload, 32) as usize,
+                    trace: flags & JOB_FLAG_TRACE != 0,
+                    document,
+                };
+                return Ok(Some(Request::Render { job_id, job }));
+            }
+            MSG_CANCEL => return Ok(Some(Request::Cancel { job_id })),
+            _ => continue,
+        }
+    }
+}
+
+/// Write a result frame for `job_id` and flush it.
+pub fn write_result<W: Write>(output: &mut W, job_id: u32, result: &RenderResult) -> io::Result<()> {
+    let message = result.message.as_bytes();
+    let rects = result.damage.as_deref().unwrap_or(&[]);
+    let flags = if result.damage.is_some() { RESULT_FLAG_DAMAGE } else { 0 };
+    let payload_len = (RESULT_HEADER_LEN + rects.len() * DAMAGE_RECT_LEN + message.len()) as u32;
+
+    let mut frame = Vec::with_capacity(FRAME_HEADER_LEN + payload_len as usize);
+    frame.extend_from_slice(&MAGIC.to_le_bytes());
+    frame.extend_from_slice(&MSG_RESULT.to_le_bytes());
+    frame.extend_from_slice(&flags.to_le_bytes());
+    frame.extend_from_slice(&job_id.to_le_bytes());
+    frame.extend_from_slice(&payload_len.to_le_bytes());
+    for field in [result.status, result.width, result.height, result.stride, result.pixel_format, rects.len() as u32] {
+        frame.extend_from_slice(&field.to_le_bytes());
+    }
+    frame.extend_from_slice(&result.frame_offset.to_le_bytes());
+    for rect in rects {
+        for field in [rect.x, rect.y, rect.width, rect.height] {
+            frame.extend_from_slice(&field.to_le_bytes());
+        }
+    }
+    frame.extend_from_slice(message);
+
+    output.write_all(&frame)?;
+    output.flush()
+}
+
+/// Write a trace frame with `spans` for `job_id`; the result frame that
+/// follows flushes it.
+pub fn write_trace<W: Write>(output: &mut W, job_id: u32, spans: &[Span]) -> io::Result<()> {
+    let payload_len: usize = 4 + spans.iter().map(|span| 20 + span.name.len()).sum::<usize>();
+
+    let mut frame = Vec::with_capacity(FRAME_HEADER_LEN + payload_len);
+    frame.extend_from_slice(&MAGIC.to_le_bytes());
+    frame.extend_from_slice(&MSG_TRACE.to_le_bytes());
+    frame.extend_from_slice(&0u16.to_le_bytes());
+    frame.extend_from_slice(&job_id.to_le_bytes());
+    frame.extend_from_slice(&(payload_len as u32).to_le_bytes());
+    frame.extend_from_slice(&(spans.len() as u32).to_le_bytes());
+    for span in spans {
+        frame.extend_from_slice(&span.start_ns.to_le_bytes());
+        frame.extend_from_slice(&span.end_ns.to_le_bytes());
+        frame.extend_from_slice(&(span.name.len() as u32).to_le_bytes());
+        frame.extend_from_slice(span.name.as_bytes());
+    }
+    output.write_all(&frame)
+}
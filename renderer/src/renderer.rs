@@ -3,6 +3,74 @@ use crate::layout::LayoutEngine;
 
 pub struct PageRenderer;
 
+/// Pixel layouts the renderer can emit. Raw layouts use the same codes as
+/// the IPC protocol (`protocol::PIXEL_FORMAT_*`).
+#[derive(Clone, Copy, PartialEq, Debug)]
+pub enum PixelFormat {
+    /// Bytes R,G,B,A with straight alpha; what the painter produces.
+    Rgba8888,
+    /// Bytes B,G,R,A with premultiplied alpha, i.e. a native ARGB8888 `u32`
+    /// on little-endian hosts; the UI can copy it straight to its surface.
+    Bgra8888Premul,
+    /// 24-bit bottom-up BMP file (alpha dropped).
+    Bmp,
+    /// Lossless QOI stream (`codec::qoi_encode`), for snapshots.
+    Qoi,
+}
+
+impl PixelFormat {
+    pub fn parse(name: &str) -> Option<Self> {
+        match name {
+            "rgba" | "rgba8888" => Some(PixelFormat::Rgba8888),
+            "bgra" | "argb8888" | "bgra-premul" => Some(PixelFormat::Bgra8888Premul),
+            "bmp" => Some(PixelFormat::Bmp),
+            "qoi" => Some(PixelFormat::Qoi),
+            _ => None,
+        }
+    }
+
+    pub fn code(self) -> u32 {
+        match self {
+            PixelFormat::Rgba8888 => 1,
+            PixelFormat::Bgra8888Premul => 2,
+            PixelFormat::Bmp => 3,
+            PixelFormat::Qoi => 4,
+        }
+    }
+
+    pub fn from_code(code: u32) -> Option<Self> {
+        match code {
+            1 => Some(PixelFormat::Rgba8888),
+            2 => Some(PixelFormat::Bgra8888Premul),
+            _ => None,
+        }
+    }
+}
+
+/// Convert painted RGBA pixels to `format` in place. `Rgba8888` (and the
+/// encoded formats, `Bmp` and `Qoi`) leave the buffer untouched.
+pub fn convert_pixels(pixels: &mut [u8], format: PixelFormat) {
+    if format != PixelFormat::Bgra8888Premul {
+        return;
+    }
+    for px in pixels.chunks_exact_mut(4) {
+        let a = px[3] as u32;
+        if a == 255 {
+            px.swap(0, 2);
+        } else {
+            let premul = |c: u8| ((c as u32 * a + 127) / 255) as u8;
+            let (r, g, b) = (px[0], px[1], px[2]);
+            px[0] = premul(b);
+            px[1] = premul(g);
+            px[2] = premul(r);
+        }
+    }
+}
+
+/// Size of the header written in front of raw pixel dumps:
+/// "SQPX", u32 format code, u32 width, u32 height, u32 stride (little-endian).
+pub const RAW_HEADER_LEN: usize = 20;
+
 pub struct RenderOutput {
     pub pixels: Vec<u8>,
     pub width: u32,
@@ -15,23 +83,30 @@ impl PageRenderer {
         width: u32,
         height: u32,
     ) -> RenderOutput {
-        // Step 1: Layout
-        let layout = LayoutEngine::layout(doc, width as f32, height as f32);
-
-        // Step 2: Paint
         // Use a simple in-memory RGBA buffer so we don't depend on the `image` crate.
         let mut img = SimpleImage::new(width, height);
-        img.fill(255, 255, 255, 255);
-
-        // Paint layout boxes
-        Self::paint_tree(&layout.root, &mut img);
+        Self::render_into(doc, &mut Canvas { width, height, pixels: &mut img.pixels });
 
         let pixels = img.into_raw();
 
         RenderOutput { pixels, width, height }
     }
 
-    fn paint_tree(layout: &crate::layout::LayoutBox, img: &mut SimpleImage) {
+    /// Lay out and paint `doc` into caller-owned RGBA memory (top-down,
+    /// `width * 4` bytes per row). Used by `--serve` to paint straight into
+    /// the shared frame without an intermediate buffer.
+    pub fn render_into(doc: &Document, canvas: &mut Canvas) {
+        // Step 1: Layout
+        let layout = LayoutEngine::layout(doc, canvas.width as f32, canvas.height as f32);
+
+        // Step 2: Paint
+        canvas.fill(255, 255, 255, 255);
+
+        // Paint layout boxes
+        Self::paint_tree(&layout.root, canvas);
+    }
+
+    fn paint_tree(layout: &crate::layout::LayoutBox, img: &mut Canvas) {
         // Draw box borders
         if layout.height > 0.0 && layout.width > 0.0 {
             let tag = layout
@@ -59,7 +134,7 @@ impl PageRenderer {
         }
     }
 
-    fn draw_text(img: &mut SimpleImage, x: u32, y: u32, text: &str, r: u8, g: u8, b: u8) {
+    fn draw_text(img: &mut Canvas, x: u32, y: u32, text: &str, r: u8, g: u8, b: u8) {
         // Use bitmap font for text rendering
         let mut px = x as i32;
         // baseline offset and scale computed from image width so large outputs get larger glyphs
@@ -76,80 +151,90 @@ impl PageRenderer {
             if px + (3 * scale as i32) >= img.width as i32 {
                 break;
             }
-            crate::bitmap_font::draw_char_scaled(&mut img.pixels, img.width, img.height, px, py, c, r, g, b, scale);
+            crate::bitmap_font::draw_char_scaled(img.pixels, img.width, img.height, px, py, c, r, g, b, scale);
             px += (3 * scale as i32) + (1 * scale as i32); // char width*scale + spacing
         }
     }
 }
 
 impl RenderOutput {
-    /// Save the rendered image as a BMP file (no external crates).
-    pub fn to_bmp(&self, path: &str) -> Result<(), Box<dyn std::error::Error>> {
+    /// Encode as a self-describing raw buffer (`RAW_HEADER_LEN` header then
+    /// tightly packed rows) in `format`, ready to be memcpy'd by the UI.
+    pub fn encode_raw(&self, format: PixelFormat) -> Vec<u8> {
+        let stride = self.width * 4;
+        let mut out = Vec::with_capacity(RAW_HEADER_LEN + self.pixels.len());
+        out.extend_from_slice(b"SQPX");
+        for field in [format.code(), self.width, self.height, stride] {
+            out.extend_from_slice(&field.to_le_bytes());
+        }
+        out.extend_from_slice(&self.pixels);
+        convert_pixels(&mut out[RAW_HEADER_LEN..], format);
+        out
+    }
+
+    /// Save in `format`: a BMP or QOI file, or a raw dump from `encode_raw`.
+    pub fn save(&self, path: &str, format: PixelFormat) -> Result<(), Box<dyn std::error::Error>> {
+        match format {
+            PixelFormat::Bmp => self.to_bmp(path),
+            PixelFormat::Qoi => Ok(std::fs::write(path, crate::codec::qoi_encode(&self.pixels, self.width, self.height))?),
+            raw => Ok(std::fs::write(path, self.encode_raw(raw))?),
+        }
+    }
+
+    /// Encode the rendered image as a 24-bit BMP file (no external crates).
+    /// Rows are converted into one buffer sized up front, so the file goes
+    /// out in a single write instead of one write per pixel.
+    pub fn encode_bmp(&self) -> Vec<u8> {
         // We'll write a 24-bit BMP (BGR) ignoring alpha.
         let w = self.width as u32;
         let h = self.height as u32;
-        let row_pad = (4 - (w * 3) % 4) % 4;
-        let mut file = std::fs::File::create(path)?;
+        let row_pad = ((4 - (w * 3) % 4) % 4) as usize;
 
-        let pixel_data_size = (w * 3 + row_pad) * h;
+        let bmp_row = (w * 3) as usize + row_pad;
+        let pixel_data_size = bmp_row as u32 * h;
         let file_size = 14 + 40 + pixel_data_size;
+        let mut out = Vec::with_capacity(file_size as usize);
 
         // BITMAPFILEHEADER
-        file.write_all(&[
-            b'B', b'M',
-            (file_size & 0xFF) as u8,
-            ((file_size >> 8) & 0xFF) as u8,
-            ((file_size >> 16) & 0xFF) as u8,
-            ((file_size >> 24) & 0xFF) as u8,
-            0, 0, 0, 0, // reserved
-            54, 0, 0, 0, // pixel data offset
-        ])?;
+        out.extend_from_slice(&[b'B', b'M']);
+        out.extend_from_slice(&file_size.to_le_bytes());
+        out.extend_from_slice(&[0, 0, 0, 0]); // reserved
+        out.extend_from_slice(&54u32.to_le_bytes()); // pixel data offset
 
         // BITMAPINFOHEADER
-        file.write_all(&[
-            40, 0, 0, 0,
-            (w & 0xFF) as u8,
-            ((w >> 8) & 0xFF) as u8,
-            ((w >> 16) & 0xFF) as u8,
-            ((w >> 24) & 0xFF) as u8,
-            (h & 0xFF) as u8,
-            ((h >> 8) & 0xFF) as u8,
-            ((h >> 16) & 0xFF) as u8,
-            ((h >> 24) & 0xFF) as u8,
-            1, 0, // planes
-            24, 0, // bits per pixel
-            0, 0, 0, 0, // compression
-            (pixel_data_size & 0xFF) as u8,
-            ((pixel_data_size >> 8) & 0xFF) as u8,
-            ((pixel_data_size >> 16) & 0xFF) as u8,
-            ((pixel_data_size >> 24) & 0xFF) as u8,
-            0, 0, 0, 0, // ppm X
-            0, 0, 0, 0, // ppm Y
-            0, 0, 0, 0, // colors used
-            0, 0, 0, 0, // important colors
-        ])?;
-
-        // Pixel data: BMP stores rows bottom-up
-        for row in (0..h).rev() {
-            for col in 0..w {
-                let i = ((row * w + col) * 4) as usize;
-                let r = self.pixels[i];
-                let g = self.pixels[i + 1];
-                let b = self.pixels[i + 2];
-                file.write_all(&[b, g, r])?;
-            }
-            // padding
-            for _ in 0..row_pad {
-                file.write_all(&[0u8])?;
+        out.extend_from_slice(&40u32.to_le_bytes());
+        out.extend_from_slice(&w.to_le_bytes());
+        out.extend_from_slice(&h.to_le_bytes());
+        out.extend_from_slice(&[1, 0]); // planes
+        out.extend_from_slice(&[24, 0]); // bits per pixel
+        out.extend_from_slice(&[0, 0, 0, 0]); // compression
+        out.extend_from_slice(&pixel_data_size.to_le_bytes());
+        out.extend_from_slice(&[0; 16]); // ppm X/Y, colors used, important colors
+
+        // Pixel data: BMP stores rows bottom-up; padding bytes stay zero
+        let header_len = out.len();
+        out.resize(file_size as usize, 0);
+        let row_bytes = (w * 4) as usize;
+        let src_rows = self.pixels.chunks_exact(row_bytes).take(h as usize).rev();
+        for (src, dst) in src_rows.zip(out[header_len..].chunks_exact_mut(bmp_row)) {
+            for (s, d) in src.chunks_exact(4).zip(dst.chunks_exact_mut(3)) {
+                d[0] = s[2];
+                d[1] = s[1];
+                d[2] = s[0];
             }
         }
 
+        out
+    }
+
+    /// Save the rendered image as a BMP file with a single write.
+    pub fn to_bmp(&self, path: &str) -> Result<(), Box<dyn std::error::Error>> {
+        std::fs::write(path, self.encode_bmp())?;
         Ok(())
     }
 }
 
 // Simple RGBA image helper without external crates
-use std::io::Write;
 
 pub struct SimpleImage {
     pub width: u32,
@@ -183,3 +268,20 @@ impl SimpleImage {
 
     pub fn into_raw(self) -> Vec<u8> { self.pixels }
 }
+
+/// Borrowed RGBA paint target; the backing memory may be a `SimpleImage` or a
+/// shared-memory frame owned by the UI process.
+pub struct Canvas<'a> {
+    pub width: u32,
+    pub height: u32,
+    pub pixels: &'a mut [u8], // RGBA
+}
+
+impl<'a> Canvas<'a> {
+    pub fn fill(&mut self, r: u8, g: u8, b: u8, a: u8) {
+        let len = (self.width * self.height * 4) as usize;
+        for px in self.pixels[..len].chunks_exact_mut(4) {
+            px.copy_from_slice(&[r, g, b, a]);
+        }
+    }
+}
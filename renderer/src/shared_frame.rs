@@ -0,0 +1,57 @@
+// Shared-memory frame target for the long-lived renderer (`--serve` mode).
+// The browser UI creates a memfd, sizes it, and hands it to us as an inherited
+// file descriptor; we map it and paint straight into it so a render never
+// touches the filesystem or re-encodes pixels.
+
+use std::os::raw::{c_int, c_void};
+
+extern "C" {
+    fn mmap(addr: *mut c_void, len: usize, prot: c_int, flags: c_int, fd: c_int, offset: i64) -> *mut c_void;
+    fn munmap(addr: *mut c_void, len: usize) -> c_int;
+}
+
+const PROT_READ: c_int = 0x1;
+const PROT_WRITE: c_int = 0x2;
+const MAP_SHARED: c_int = 0x01;
+
+pub struct SharedFrame {
+    fd: c_int,
+    ptr: *mut u8,
+    len: usize,
+}
+
+impl SharedFrame {
+    pub fn new(fd: c_int) -> Self {
+        Self { fd, ptr: std::ptr::null_mut(), len: 0 }
+    }
+
+    /// Map (or re-map) the segment so at least `len` bytes are addressable.
+    /// The UI only ever grows the memfd, so an existing mapping is reused
+    /// until a larger capacity is announced.
+    pub fn map(&mut self, len: usize) -> Result<&mut [u8], String> {
+        if len > self.len {
+            self.unmap();
+            let p = unsafe { mmap(std::ptr::null_mut(), len, PROT_READ | PROT_WRITE, MAP_SHARED, self.fd, 0) };
+            if p as isize == -1 {
+                return Err(format!("mmap of {} bytes on fd {} failed", len, self.fd));
+            }
+            self.ptr = p as *mut u8;
+            self.len = len;
+        }
+        Ok(unsafe { std::slice::from_raw_parts_mut(self.ptr, len) })
+    }
+
+    fn unmap(&mut self) {
+        if !self.ptr.is_null() {
+            unsafe { munmap(self.ptr as *mut c_void, self.len) };
+            self.ptr = std::ptr::null_mut();
+            self.len = 0;
+        }
+    }
+}
+
+impl Drop for SharedFrame {
+    fn drop(&mut self) {
+        self.unmap();
+    }
+}
@@ -0,0 +1,55 @@
+// Spans of one render job for the browser UI's frame trace. They are
+// stamped with CLOCK_MONOTONIC, the clock the UI traces with, so the UI can
+// put them on its own timeline as they are (see `protocol::write_trace`).
+
+use std::os::raw::{c_int, c_long};
+
+#[repr(C)]
+struct Timespec {
+    tv_sec: i64,
+    tv_nsec: c_long,
+}
+
+extern "C" {
+    fn clock_gettime(clock_id: c_int, tp: *mut Timespec) -> c_int;
+}
+
+#[cfg(target_os = "macos")]
+const CLOCK_MONOTONIC: c_int = 6;
+#[cfg(not(target_os = "macos"))]
+const CLOCK_MONOTONIC: c_int = 1;
+
+pub fn now_ns() -> u64 {
+    let mut ts = Timespec { tv_sec: 0, tv_nsec: 0 };
+    unsafe { clock_gettime(CLOCK_MONOTONIC, &mut ts) };
+    ts.tv_sec as u64 * 1_000_000_000 + ts.tv_nsec as u64
+}
+
+pub struct Span {
+    pub name: &'static str,
+    pub start_ns: u64,
+    pub end_ns: u64,
+}
+
+/// Records spans only when the job asked for them.
+pub struct Spans {
+    enabled: bool,
+    pub spans: Vec<Span>,
+}
+
+impl Spans {
+    pub fn new(enabled: bool) -> Self {
+        Self { enabled, spans: Vec::new() }
+    }
+
+    /// Run `f`, recording how long it took as `name`.
+    pub fn time<R>(&mut self, name: &'static str, f: impl FnOnce() -> R) -> R {
+        if !self.enabled {
+            return f();
+        }
+        let start_ns = now_ns();
+        let result = f();
+        self.spans.push(Span { name, start_ns, end_ns: now_ns() });
+        result
+    }
+}